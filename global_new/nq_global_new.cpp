@@ -0,0 +1,194 @@
+/*
+** Replacement of the global operator new and delete, routed through the
+** memlib and logged in the CurrentDomain (the Domain of the innermost
+** nq::domain_scope of the thread, UnknownDomain otherwise).
+**
+** It is NOT part of nq_mem: link nq_mem_global_new (or compile this file
+** in the executable) to opt in. Every new of the process, std containers
+** and third parties included, then goes through the memlib.
+**
+** The memory comes from the slab pools of PoolAlloc, or from malloc when
+** built with NQ_GLOBAL_NEW_MALLOC (CMake GLOBAL_NEW_WITH_MALLOC): the pools
+** give each allocation over 32 KiB a run of 2 MiB chunks of its own.
+**
+** Nothing called from here (Domains constructors, BaseDomain::add...) may
+** use operator new, it would come back here.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "../include/nq_memlib/alloc_strat.h"
+#include "../include/nq_memlib/lib_domains.h"
+#include "../include/nq_memlib/nq_memlib_tools.h"
+#include "../include/nq_memlib/pool_alloc.h"
+
+namespace
+{
+#ifdef NQ_GLOBAL_NEW_MALLOC
+    typedef DefaultAlloc GlobalAlloc;
+#else // NQ_GLOBAL_NEW_MALLOC
+    /* The fastest AllocStrat of the memlib */
+    typedef PoolAlloc<> GlobalAlloc;
+#endif // !NQ_GLOBAL_NEW_MALLOC
+
+    /* align is 1 for the operator new without std::align_val_t */
+    void* global_new(std::size_t size, std::size_t align = 1)
+    {
+        /* new must return a unique pointer, even for 0 bytes */
+        if (size == 0)
+            size = 1;
+
+        for (;;)
+        {
+            try
+            {
+                return nq::memlib::allocate_log_aligned<CurrentDomain,
+                       GlobalAlloc>(size, CurrentDomain::header_size, align);
+            }
+            catch (const std::bad_alloc&)
+            {
+                /* standard behaviour, let the new_handler free memory */
+                std::new_handler handler = std::get_new_handler();
+                if (handler == nullptr)
+                    throw;
+                handler();
+            }
+        }
+    }
+
+    void* global_new_nothrow(std::size_t size,
+            std::size_t align = 1) noexcept
+    {
+        try
+        {
+            return global_new(size, align);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void global_delete(void *ptr, std::size_t align = 1) noexcept
+    {
+        nq::memlib::deallocate_log<CurrentDomain, GlobalAlloc>(ptr,
+                CurrentDomain::header_size, align);
+    }
+} // namespace
+
+/*** operator new ***/
+
+void* operator new(std::size_t size)
+{
+    return global_new(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return global_new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return global_new_nothrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return global_new_nothrow(size);
+}
+
+/*** operator delete ***/
+
+void operator delete(void *ptr) noexcept
+{
+    global_delete(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    global_delete(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+    global_delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+    global_delete(ptr);
+}
+
+#if __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    global_delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    global_delete(ptr);
+}
+#endif // !__cpp_sized_deallocation
+
+/*** over-aligned operator new and delete (C++17) ***/
+
+#if __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return global_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return global_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new(std::size_t size, std::align_val_t align,
+        const std::nothrow_t&) noexcept
+{
+    return global_new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align,
+        const std::nothrow_t&) noexcept
+{
+    return global_new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr, std::align_val_t align) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void *ptr, std::align_val_t align) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr, std::align_val_t align,
+        const std::nothrow_t&) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void *ptr, std::align_val_t align,
+        const std::nothrow_t&) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr, std::size_t,
+        std::align_val_t align) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void *ptr, std::size_t,
+        std::align_val_t align) noexcept
+{
+    global_delete(ptr, static_cast<std::size_t>(align));
+}
+#endif // !__cpp_aligned_new
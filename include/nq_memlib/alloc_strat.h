@@ -2,23 +2,73 @@
 # define ALLOC_STRAT_H_
 
 # include <cstdlib>
+# include <cstddef>
+
+# include "env_maccro.h"
+
+# ifdef NQ_WIN_
+#  include <malloc.h>
+# endif // NQ_WIN_
 
 /*
-template < int T, bool ... > class PoolAlloc
-{};
-template <int size = 126, bool ThreadSafe = true>
+** An AllocStrat gives raw memory to the memlib:
+**  -void* allocate(std::size_t size)
+**  -void* allocate(std::size_t size, std::size_t align) (optional)
+**  -void deallocate(void *ptr, std::size_t size)
+** The size given to deallocate is the one given to allocate, so a strategy
+** doesn't need to store it. A strategy may only implement
+** deallocate(void *ptr) if it has no use of the size, and must implement it
+** to be used by NQ_NEW or the global operator delete (they don't know it).
+** The aligned allocate is needed to allocate types aligned on more than
+** alignof(std::max_align_t), its memory is given back to deallocate too.
+** A strategy may also implement
+**  -void* reallocate(void *ptr, std::size_t old_size, std::size_t new_size,
+**      std::size_t align)
+** to resize an allocation without copying it (nullptr when it can't), see
+** MmapAlloc.
+*/
+/*
+** malloc and free, posix_memalign for the over-aligned memory.
+** Windows can't free _aligned_malloc'd memory with free, every allocation
+** goes through _aligned_malloc there so deallocate doesn't need the align.
 */
-
 struct DefaultAlloc
 {
     void* allocate(std::size_t size)
     {
+# ifdef NQ_WIN_
+        return _aligned_malloc(size, alignof(std::max_align_t));
+# else // NQ_WIN_
         return std::malloc(size);
+# endif // !NQ_WIN_
+    }
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        if (align <= alignof(std::max_align_t))
+            return allocate(size);
+# ifdef NQ_WIN_
+        return _aligned_malloc(size, align);
+# else // NQ_WIN_
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, align, size) != 0)
+            return nullptr;
+        return ptr;
+# endif // !NQ_WIN_
     }
 
     void deallocate(void *ptr)
     {
+# ifdef NQ_WIN_
+        _aligned_free(ptr);
+# else // NQ_WIN_
         std::free(ptr);
+# endif // !NQ_WIN_
+    }
+
+    void deallocate(void *ptr, std::size_t)
+    {
+        deallocate(ptr);
     }
 };
 
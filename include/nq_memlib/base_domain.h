@@ -3,13 +3,20 @@
 
 # include <cassert>
 # include <cstddef>
+# include <new>
 # include <utility>
 
 # include <iostream>
+# include <string>
+# include <vector>
 
+# include <atomic>
 # include <mutex>
 
 # include "env_maccro.h"
+# include "alloc_strat.h"
+# include "contended_mutex.h"
+# include "latency_histogram.h"
 # include "tree.h"
 
 /*
@@ -22,17 +29,186 @@
 ** Placing them there avoid costy extra allocation for every logging.
 */
 
+class BaseDomain;
+
 namespace nq { namespace memlib {
-    void remove_header_operator_delete(void *ptr);
+    inline void remove_header_operator_delete(void *internal_ptr);
+    inline void retag_header_operator_delete(void *internal_ptr,
+            BaseDomain& to);
+
+    /*
+    ** What a Domain does with the allocations it receives, can be changed at
+    ** runtime (see BaseDomain::set_level and the NQ_MEMLIB_LEVEL variables)
+    **  -track_off: nothing is logged
+    **  -track_counters: only nb_alloc and size_alloc are kept (no lock)
+    **  -track_sampled: counters plus one header in sample_rate is listed
+    **  -track_full: every header is listed (file, line, leaks dumps)
+    */
+    enum TrackingLevel
+    {
+        track_off = 0,
+        track_counters,
+        track_sampled,
+        track_full
+    };
+
+    /* return the level named name ("off", "counters"...), or dflt */
+    TrackingLevel tracking_level_from_string(const char* name,
+            TrackingLevel dflt);
+    const char* tracking_level_to_string(TrackingLevel level);
+
+    /*
+    ** The Domains whose policy has thread_stats count the live bytes per
+    ** allocating thread and the frees per pair of allocating and freeing
+    ** threads. A thread gets its index
+    ** at its first tracked allocation, the threads past the first
+    ** tracked_threads - 1 ones share the last index (the indexes are not
+    ** reused).
+    */
+    enum { tracked_threads = 16 };
+    size_t thread_index();
+
+    /*
+    ** The Domains whose policy has type_stats count their live allocations
+    ** per element type, named by TypeToString (see type_stat_id). The id 0
+    ** is the one of the allocations without type, and of the types past
+    ** tracked_types: it isn't counted.
+    */
+    enum { tracked_types = 64 };
+    /* id of the type named name, registered at its first use */
+    size_t register_type(const char* name);
+    /* name of the type id, nullptr if none has it */
+    const char* type_name(size_t id);
+
+    /*
+    ** The policy of a Domain holds the performance decisions of everything
+    ** logged in it, so they are taken once per Domain (see NQ_DOMAIN_EX)
+    ** instead of at every call site:
+    **  -alloc_strat: AllocStrat used when a container, New, allocator...
+    **   does not specify one
+    **  -level, sample_rate: TrackingLevel and sample rate the Domain starts
+    **   with (the NQ_MEMLIB_LEVEL variables still override them)
+    **  -alignment: minimal alignment of the memory given by the Domain
+    **   (0 for the default one)
+    **  -side_table_threshold: the allocations of at least this size made
+    **   by the allocators and New keep their Header in the side table
+    **   instead of before their memory (0 to never do it)
+    **  -emergency_reserve: bytes taken up front, given to the allocations
+    **   of the Domain when its AllocStrat fails (see EmergencyReserve)
+    **  -profile_stats: the Domain keeps the peak of its live allocations
+    **   per size class of the pools (see nq_profile.h)
+    **  -thread_stats: the Domain counts its live bytes per allocating
+    **   thread and its frees per pair of threads (see thread_index)
+    **  -type_stats: the allocators and New of the Domain count their live
+    **   allocations per element type (see register_type)
+    **  -latency_stats: the allocators and New of the Domain time their
+    **   AllocStrat calls and their bookkeeping (see LatencyHistogram)
+    ** A user policy inherits from DefaultDomainPolicy and only redefines
+    ** what changes.
+    */
+    struct DefaultDomainPolicy
+    {
+        typedef DefaultAlloc alloc_strat;
+        enum { level = track_full,
+            sample_rate = 1,
+            alignment = 0,
+            side_table_threshold = 4096,
+            emergency_reserve = 0,
+            profile_stats = 0,
+            thread_stats = 0,
+            type_stats = 0,
+            latency_stats = 0 };
+    };
+
+    /*
+    ** What backs the memory of an allocation, told by its AllocStrat (see
+    ** huge_backed and prefaulted) and counted by its Domain
+    */
+    enum Backing { backed_huge = 1,
+        backed_prefaulted = 2 };
+
+    /*
+    ** Quotas of a Domain (see BaseDomain::set_quota):
+    **  -QuotaCallback: called when the Domain crosses its soft quota, size
+    **   is the allocation crossing it
+    **  -QuotaHandler: called when an allocation would cross the hard quota,
+    **   returns true to let it go on (memory was freed...), false to throw
+    **   domain_bad_alloc
+    */
+    typedef void (*QuotaCallback)(BaseDomain& dom, size_t size);
+    typedef bool (*QuotaHandler)(BaseDomain& dom, size_t size);
+
+    /* the bad_alloc thrown when a Domain is at its hard quota */
+    class domain_bad_alloc : public std::bad_alloc
+    {
+    public:
+        explicit domain_bad_alloc(const char* domain)
+            : domain_(domain)
+        {}
+
+        /* name of the Domain */
+        const char* domain() const noexcept { return domain_; }
+
+        virtual const char* what() const noexcept override
+        { return "nq::memlib::domain_bad_alloc"; }
+    private:
+        const char* domain_;
+    };
+
+    /* AllocStrat used by default for the allocations logged in Domain */
+    template<class Domain>
+    using domain_alloc_strat = typename Domain::policy::alloc_strat;
 }} // nq::memlib
 
+/*
+** Copy of the state of a Domain at a given time, filled by
+** BaseDomain::snapshot() so a report can be written without holding any
+** Domain mutex.
+*/
+struct CallSiteSnapshot
+{
+    const char* file;
+    size_t line;
+    size_t size;
+};
+
+struct DomainSnapshot
+{
+    const char* name;
+    size_t depth; // height of the Domain in the Domains tree
+    size_t count;
+    size_t size;
+    size_t huge_size; // part of size backed by huge pages
+    size_t faulted_size; // part of size faulted in beforehand
+    size_t reserved_size; // bytes reserved up front for the Domain
+    /* live bytes per allocating thread, frees per allocating x freeing */
+    size_t thread_live[nq::memlib::tracked_threads];
+    size_t thread_frees[nq::memlib::tracked_threads]
+        [nq::memlib::tracked_threads];
+    /* live allocations and bytes per type id (see type_stats) */
+    size_t type_count[nq::memlib::tracked_types];
+    size_t type_live[nq::memlib::tracked_types];
+    /* time spent in the AllocStrat and in the Domain (see latency_stats) */
+    nq::memlib::LatencySnapshot strategy_latency;
+    nq::memlib::LatencySnapshot domain_latency;
+    /* acquisitions of the Domain mutex, and the nanoseconds waited */
+    size_t lock_uncontended;
+    size_t lock_contended;
+    uint64_t lock_wait_ns;
+    nq::memlib::TrackingLevel level;
+    /* true if allocations were made while copying and some were missed */
+    bool truncated;
+    std::vector<CallSiteSnapshot> sites;
+};
+
 # ifdef WITH_NQ_MEMLOG
 class BaseDomain : public slwn::BaseTree<int, int>
 {
 private:
-    // TODO remove that
     // operator delete function only have to know about Header Structure.
-    friend void nq::memlib::remove_header_operator_delete(void *ptr);
+    friend void nq::memlib::remove_header_operator_delete(void *internal_ptr);
+    friend void nq::memlib::retag_header_operator_delete(void *internal_ptr,
+            BaseDomain& to);
 
     typedef slwn::BaseTree<int, int> Super;
     
@@ -43,24 +219,40 @@ private:
         Header *next_;
         /* We use a size_t instead of others int (uint**_t, etc..) to get
         * a 32 and 64 bits adaptability */
-        const size_t size_;
+        size_t size_;
 
-        /* The padding is here for allignement */
+        /* The flags are also here for allignement */
         /*
-        ** !It's also used to log wheter the Header is a SubHeader or not;
-        ** it avoids dynamic_cast for a static_cast (less costy)
+        ** !They log wheter the Header is a SubHeader or not, it avoids
+        ** dynamic_cast for a static_cast (less costy).
+        ** They also keep what the Domain did with the Header when it was
+        ** added, so remove() undoes exactly that even if the Domain level
+        ** changed in between.
         */
-        const size_t padding_;
+        size_t flags_;
     public:
-        Header(size_t size, size_t padding = 0,
+        enum FLAGSENUM { sub_header_flag = 1,
+            counted_flag = 2,
+            listed_flag = 4,
+            huge_flag = 8, // the memory is backed by huge pages
+            prefaulted_flag = 16, // its pages were faulted in beforehand
+            cursor_flag = 32, // a position kept by snapshot, no allocation
+            thread_shift = 8, // the allocating thread_index() from there
+            thread_mask = 0xff << thread_shift,
+            type_shift = 16, // the id of its type (see register_type)
+            type_mask = 0xff << type_shift };
+
+        Header(size_t size, size_t flags = 0,
                 Header *prev = nullptr, Header *next = nullptr)
             : prev_(prev),
             next_(next),
             size_(size),
-            padding_(padding)
+            flags_(flags)
         {}
         void add(Header *next);
         void remove();
+        /* link the Header between prev and its next, prev isn't the end */
+        void insert_after(Header *prev);
 
         /* remove_begin()/remove_end() return a Header* so the Domain can put
          * his begin_/end_ pointers up-to-date */
@@ -68,6 +260,44 @@ private:
         Header* remove_end();
 
         inline size_t size() const { return size_; }
+        inline const Header* next() const { return next_; }
+        inline Header* next() { return next_; }
+        inline bool is_sub_header() const
+        { return (flags_ & sub_header_flag) != 0; }
+        inline bool is_counted() const
+        { return (flags_ & counted_flag) != 0; }
+        inline bool is_listed() const
+        { return (flags_ & listed_flag) != 0; }
+        inline bool is_huge() const
+        { return (flags_ & huge_flag) != 0; }
+        inline bool is_prefaulted() const
+        { return (flags_ & prefaulted_flag) != 0; }
+        inline bool is_cursor() const
+        { return (flags_ & cursor_flag) != 0; }
+        inline size_t thread() const
+        { return (flags_ & thread_mask) >> thread_shift; }
+        inline size_t type() const
+        { return (flags_ & type_mask) >> type_shift; }
+        inline void set_flags(size_t flags) { flags_ |= flags; }
+        inline void set_thread(size_t index)
+        { flags_ = (flags_ & ~static_cast<size_t>(thread_mask))
+            | (index << thread_shift); }
+        /* its memory was resized, backing is its huge/prefaulted flags */
+        inline void set_size(size_t size, size_t backing)
+        {
+            size_ = size;
+            flags_ = (flags_
+                    & ~static_cast<size_t>(huge_flag | prefaulted_flag))
+                | backing;
+        }
+
+        /* forget the list and the tracking of its Domain (see retag) */
+        inline void detach()
+        {
+            prev_ = nullptr;
+            next_ = nullptr;
+            flags_ &= ~static_cast<size_t>(counted_flag | listed_flag);
+        }
 
         /* print the Header datas in the stream */
         void
@@ -89,7 +319,7 @@ private:
         size_t nothing_;
     public:
         SubHeader(size_t size, const char* file, size_t line, BaseDomain *dom)
-            : Header(size, 1, nullptr, nullptr),
+            : Header(size, sub_header_flag, nullptr, nullptr),
             file_(file),
             line_(line),
             dom_(dom),
@@ -99,18 +329,185 @@ private:
         inline const char* get_file() const { return file_; }
         inline size_t get_line() const { return line_; }
         inline BaseDomain *get_domain() const { return dom_; }
+        inline void set_domain(BaseDomain *dom) { dom_ = dom; }
     };
 private:
-    mutable std::mutex mutex_; // protect internal datas
+    /* protect internal datas, counts its contention */
+    mutable nq::memlib::ContendedMutex mutex_;
+private:
+    /*
+    ** The counters are atomics so they can be read without taking mutex_
+    ** (snapshots, dumps) and updated without it at the track_counters level
+    */
+    std::atomic<size_t> count_; // The number of non freed allocation
+    std::atomic<size_t> size_; // The total size in bytes of all allocations
+    std::atomic<size_t> huge_size_; // The part of size_ on huge pages
+    std::atomic<size_t> faulted_size_; // The part of size_ prefaulted
+    std::atomic<size_t> reserved_size_; // reserve_log'd for this Domain
+public:
+    /*
+    ** The live allocations and their peak are also counted per size class
+    ** of the pools (SlabPool::nb_classes) by the Domains with
+    ** profile_stats, the last class counts the bytes of the bigger ones
+    ** (see nq_profile.h)
+    */
+    enum PCENUM { profile_classes = 41 };
+private:
+    std::atomic<size_t> class_live_[profile_classes];
+    std::atomic<size_t> class_peak_[profile_classes];
+    bool profile_stats_;
+public:
+    enum QCENUM { max_quota_callbacks = 4 };
+private:
+    std::atomic<size_t> soft_quota_; // no_quota when not set
+    std::atomic<size_t> hard_quota_;
+    /* size from which check_quota leaves the fast path */
+    std::atomic<size_t> quota_trigger_;
+    std::atomic<bool> soft_crossed_;
+    std::atomic<nq::memlib::QuotaCallback>
+        quota_callbacks_[max_quota_callbacks];
+    std::atomic<nq::memlib::QuotaHandler> quota_handler_;
 private:
-    size_t count_ = 0; // The number of non freed allocation in the domain
-    size_t size_ = 0; // The total size in bytes of all the allocations
+    /*
+    ** The counters of a thread index (see thread_stats), on cache lines of
+    ** their own: the live bytes it allocated, and its frees per allocating
+    ** thread.
+    */
+    struct alignas(64) ThreadCounters
+    {
+        std::atomic<size_t> live;
+        std::atomic<size_t> frees[nq::memlib::tracked_threads];
+    };
+    ThreadCounters thread_counters_[nq::memlib::tracked_threads];
+    bool thread_stats_;
+    /* live allocations and bytes per type id (see type_stats) */
+    std::atomic<size_t> type_count_[nq::memlib::tracked_types];
+    std::atomic<size_t> type_live_[nq::memlib::tracked_types];
+    /* nanoseconds per call in the AllocStrat and in the Domain */
+    nq::memlib::LatencyHistogram strategy_latency_;
+    nq::memlib::LatencyHistogram domain_latency_;
 private:
     Header *begin_ = nullptr;
     Header *end_ = nullptr;
+private:
+    std::atomic<int> level_; // a nq::memlib::TrackingLevel
+    std::atomic<size_t> sample_rate_; // one header listed every sample_rate_
+    std::atomic<size_t> sample_tick_;
 public:
-    inline size_t get_count() const { return count_; }
-    inline size_t get_size() const { return size_; }
+    inline nq::memlib::TrackingLevel get_level() const
+    {
+        return static_cast<nq::memlib::TrackingLevel>(
+                level_.load(std::memory_order_relaxed));
+    }
+    inline void set_level(nq::memlib::TrackingLevel level)
+    { level_.store(level, std::memory_order_relaxed); }
+
+    inline size_t get_sample_rate() const
+    { return sample_rate_.load(std::memory_order_relaxed); }
+    inline void set_sample_rate(size_t rate)
+    { sample_rate_.store(rate ? rate : 1, std::memory_order_relaxed); }
+
+public:
+    inline size_t get_count() const
+    { return count_.load(std::memory_order_relaxed); }
+    inline size_t get_size() const
+    { return size_.load(std::memory_order_relaxed); }
+    inline size_t get_huge_size() const
+    { return huge_size_.load(std::memory_order_relaxed); }
+    inline size_t get_faulted_size() const
+    { return faulted_size_.load(std::memory_order_relaxed); }
+    inline size_t get_reserved_size() const
+    { return reserved_size_.load(std::memory_order_relaxed); }
+
+    /* peak of the live allocations of the size class index */
+    inline size_t get_class_peak(size_t index) const
+    { return class_peak_[index].load(std::memory_order_relaxed); }
+
+    /* live bytes allocated by the thread index (see thread_index) */
+    inline size_t get_thread_live(size_t index) const
+    { return thread_counters_[index].live.load(std::memory_order_relaxed); }
+    /* number of frees by free_thread of what alloc_thread allocated */
+    inline size_t get_thread_frees(size_t alloc_thread,
+            size_t free_thread) const
+    {
+        return thread_counters_[free_thread].frees[alloc_thread].load(
+                std::memory_order_relaxed);
+    }
+
+    /* live allocations and bytes of the type id (see register_type) */
+    inline size_t get_type_count(size_t id) const
+    { return type_count_[id].load(std::memory_order_relaxed); }
+    inline size_t get_type_live(size_t id) const
+    { return type_live_[id].load(std::memory_order_relaxed); }
+
+    /*
+    ** Time of the allocations and deallocations of the Domains with
+    ** latency_stats: in their AllocStrat, and in the Domain bookkeeping
+    ** (Header, counters, waits on the Domain mutex...)
+    */
+    inline const nq::memlib::LatencyHistogram& get_strategy_latency() const
+    { return strategy_latency_; }
+    inline const nq::memlib::LatencyHistogram& get_domain_latency() const
+    { return domain_latency_; }
+    inline void record_latency(uint64_t strategy_ns, uint64_t domain_ns)
+    {
+        strategy_latency_.record(strategy_ns);
+        domain_latency_.record(domain_ns);
+    }
+    inline void reset_latency()
+    {
+        strategy_latency_.reset();
+        domain_latency_.reset();
+    }
+
+    /*
+    ** Acquisitions of the Domain mutex (list of the Headers, print...)
+    ** that waited or not, and the nanoseconds waited (see ContendedMutex)
+    */
+    inline size_t get_lock_uncontended() const
+    { return mutex_.get_uncontended(); }
+    inline size_t get_lock_contended() const
+    { return mutex_.get_contended(); }
+    inline uint64_t get_lock_wait_ns() const
+    { return mutex_.get_wait_ns(); }
+    inline void reset_contention()
+    { mutex_.reset_contention(); }
+
+    inline const char* name() const
+    { return domain_name(); }
+
+    /* size bytes were reserved up front for the Domain (see reserve_log) */
+    inline void add_reserved(size_t size)
+    { reserved_size_.fetch_add(size, std::memory_order_relaxed); }
+
+public:
+    /*
+    ** Quotas of the bytes held by the Domain (no_quota for none): the
+    ** quota callbacks are called once when the soft one is crossed (again
+    ** once the Domain went back under it), an allocation crossing the hard
+    ** one calls the quota handler or throws domain_bad_alloc.
+    */
+    enum : size_t { no_quota = static_cast<size_t>(-1) };
+    void set_quota(size_t soft, size_t hard = no_quota);
+    inline size_t get_soft_quota() const
+    { return soft_quota_.load(std::memory_order_relaxed); }
+    inline size_t get_hard_quota() const
+    { return hard_quota_.load(std::memory_order_relaxed); }
+
+    /* false when max_quota_callbacks are already registered */
+    bool add_quota_callback(nq::memlib::QuotaCallback callback);
+    void remove_quota_callback(nq::memlib::QuotaCallback callback);
+    inline void set_quota_handler(nq::memlib::QuotaHandler handler)
+    { quota_handler_.store(handler, std::memory_order_relaxed); }
+
+    /* called before allocating size bytes: one compare without quota */
+    inline void check_quota(size_t size)
+    {
+        if (get_size() + size > quota_trigger_.load(std::memory_order_relaxed))
+            quota_exceeded(size);
+    }
+private:
+    void quota_exceeded(size_t size);
 
 public:
     enum HSENUM { header_size = sizeof(Header),
@@ -119,21 +516,138 @@ public:
     /* Add the Header constructed with size at the ptr location to the
      * current Domain's list */
 
-    void add(void *internal_ptr, size_t size);
+    /*
+    ** The Header is always constructed so remove() knows what to undo,
+    ** when the Domain is off that's all that is done.
+    ** backing holds the nq::memlib::Backing flags of the memory given by
+    ** the AllocStrat, type the id of its element type (see type_stat_id).
+    */
+    inline void add(void *internal_ptr, size_t size, size_t backing = 0,
+            size_t type = 0)
+    {
+        Header *head = new (internal_ptr)Header(size, backing_flags(backing)
+                | (type << Header::type_shift));
+        if (get_level() != nq::memlib::track_off)
+            track(head);
+    }
 
-    void add(void* internal_ptr, std::size_t size,
-        const char* file, size_t line, BaseDomain *dom);
+    inline void add(void* internal_ptr, std::size_t size,
+        const char* file, size_t line, BaseDomain *dom, size_t backing = 0)
+    {
+        Header *head = new (internal_ptr)SubHeader(size, file, line, dom);
+        head->set_flags(backing_flags(backing));
+        if (get_level() != nq::memlib::track_off)
+            track(head);
+    }
 
     /* Remove from the current Domain's list the Header associated with
      * the allocated ptr send */
-    void remove(void *internal_ptr);
+    inline void remove(void *internal_ptr)
+    {
+        Header *head = static_cast<Header*>(internal_ptr);
+        if (head->is_counted())
+            untrack(head);
+        /* Destructor called */
+        head->~Header();
+    }
 
-    virtual void virtual_remove(void *internal_ptr) = 0;
+    /*
+    ** Move the Header at internal_ptr, added to this Domain, to the Domain
+    ** to: it is untracked here and tracked there (at the level of to), a
+    ** SubHeader logs to as its Domain. The hard quota of to is checked
+    ** first, nothing is moved if it throws.
+    */
+    void retag(void *internal_ptr, BaseDomain& to);
+
+    /*
+    ** The memory of the Header at internal_ptr now holds size bytes (see
+    ** memlib::reallocate_log): the counters move by the difference, the
+    ** Header keeps its allocating thread, its type and its place in the
+    ** list, no free is counted.
+    */
+    void resize(void *internal_ptr, size_t size, size_t backing = 0);
+
+
+private:
+    static inline size_t backing_flags(size_t backing)
+    {
+        return ((backing & nq::memlib::backed_huge) ? Header::huge_flag : 0)
+            | ((backing & nq::memlib::backed_prefaulted)
+                    ? Header::prefaulted_flag : 0);
+    }
+
+    /*
+    ** count and, depending on the level, list the Header allocated by the
+    ** current thread
+    */
+    void track(Header *head);
+    /* track the Header keeping its allocating thread */
+    void attach(Header *head);
+    /* freed is false when the Header is only moved (see retag) */
+    void untrack(Header *head, bool freed = true);
+    /* remove a listed Header from the list, mutex_ held */
+    void unlink(Header *head);
+
+    /* count an allocation of size bytes in its size class */
+    void profile_add(size_t size);
+    void profile_remove(size_t size);
 
 protected:
     /* BaseDomain is an interface  it's constructor can't be called */
     BaseDomain()
-    {}
+        : count_(0),
+        size_(0),
+        huge_size_(0),
+        faulted_size_(0),
+        reserved_size_(0),
+        profile_stats_(false),
+        soft_quota_(no_quota),
+        hard_quota_(no_quota),
+        quota_trigger_(no_quota),
+        soft_crossed_(false),
+        quota_handler_(nullptr),
+        thread_stats_(false),
+        level_(nq::memlib::track_full),
+        sample_rate_(1),
+        sample_tick_(0)
+    {
+        for (size_t index = 0; index < profile_classes; ++index)
+        {
+            class_live_[index].store(0, std::memory_order_relaxed);
+            class_peak_[index].store(0, std::memory_order_relaxed);
+        }
+        for (size_t index = 0; index < max_quota_callbacks; ++index)
+            quota_callbacks_[index].store(nullptr, std::memory_order_relaxed);
+        for (size_t id = 0; id < nq::memlib::tracked_types; ++id)
+        {
+            type_count_[id].store(0, std::memory_order_relaxed);
+            type_live_[id].store(0, std::memory_order_relaxed);
+        }
+        for (size_t index = 0; index < nq::memlib::tracked_threads; ++index)
+        {
+            thread_counters_[index].live.store(0, std::memory_order_relaxed);
+            for (size_t alloc = 0; alloc < nq::memlib::tracked_threads;
+                    ++alloc)
+                thread_counters_[index].frees[alloc].store(0,
+                        std::memory_order_relaxed);
+        }
+    }
+
+    /* the per size class peaks are kept (see profile_stats) */
+    inline void set_profile_stats(bool profile_stats)
+    { profile_stats_ = profile_stats; }
+
+    /* the per thread counters are kept (see thread_stats) */
+    inline void set_thread_stats(bool thread_stats)
+    { thread_stats_ = thread_stats; }
+
+    /*
+    ** Read the level and sample rate of the Domain from the environment:
+    **  NQ_MEMLIB_LEVEL / NQ_MEMLIB_LEVEL_<DomainName> (off, counters...)
+    **  NQ_MEMLIB_SAMPLE_RATE / NQ_MEMLIB_SAMPLE_RATE_<DomainName>
+    ** Called by the Domains constructors, domain_name() is then available.
+    */
+    void init_from_env();
 private:
     BaseDomain(const BaseDomain&) {}
     BaseDomain& operator=(const BaseDomain&) { return *this; };
@@ -146,12 +660,44 @@ public:
     /* printer for the debug, will probably to change */
     virtual void
     print(std::ostream& = std::cout, size_t = 0) const override;
+private:
+    /* the per thread and per type lines of print */
+    void print_breakdown(std::ostream& os, const std::string& tabs) const;
+    static void print_latency(std::ostream& os, const std::string& tabs,
+            const char* name, const nq::memlib::LatencySnapshot& latency);
+public:
+
+    /* Headers copied by snapshot for each lock of mutex_ */
+    enum SCENUM { snapshot_chunk = 256 };
+
+    /*
+    ** Append the snapshot of this domain, its sons and its brothers to snaps.
+    ** The call sites are copied in a buffer reserved beforehand, at most
+    ** snapshot_chunk Headers per lock of mutex_: an allocating thread never
+    ** waits for more than one chunk, whatever the number of live Headers.
+    ** No allocation nor output is done under the lock.
+    */
+    void snapshot(std::vector<DomainSnapshot>& snaps, size_t depth = 0);
+
+    /* call fun on this Domain, its sons and its brothers */
+    template<class Fun>
+    void for_each(const Fun& fun)
+    {
+        fun(*this);
+        if (Super::sons_ != nullptr)
+            static_cast<BaseDomain*>(Super::sons_)->for_each(fun);
+        if (Super::brothers_ != nullptr)
+            static_cast<BaseDomain*>(Super::brothers_)->for_each(fun);
+    }
+
+    /* return the Domain named name in this Domain branch, or nullptr */
+    BaseDomain* find(const char* name);
 
 private:
     virtual std::tuple<int, int>
     get_node_infos() const override
     {
-        return std::tuple<int, int>(count_, size_);
+        return std::tuple<int, int>(get_count(), get_size());
     }
 
 # ifdef NQ_ENV_32
@@ -174,80 +720,196 @@ public:
     enum HSENUM { header_size = 0,
         sub_header_size = 0 };
 
-    inline void add(void*, size_t) {}
+    inline void add(void*, size_t, size_t = 0, size_t = 0) {}
 
     inline void add(void*, std::size_t,
-        const char*, size_t, BaseDomain*) {}
+        const char*, size_t, BaseDomain*, size_t = 0) {}
 
     inline void remove(void*) {}
 
+    inline void retag(void*, BaseDomain&) {}
+
+    inline void resize(void*, size_t, size_t = 0) {}
+
     inline virtual
     void print(std::ostream& = std::cout, size_t = 0) const override {}
 
     inline size_t get_count() const { return 0; }
+    inline size_t get_size() const { return 0; }
+    inline size_t get_huge_size() const { return 0; }
+    inline size_t get_faulted_size() const { return 0; }
+    inline size_t get_reserved_size() const { return 0; }
+    inline void add_reserved(size_t) {}
+
+    enum PCENUM { profile_classes = 41 };
+    inline size_t get_class_peak(size_t) const { return 0; }
+    inline size_t get_thread_live(size_t) const { return 0; }
+    inline size_t get_thread_frees(size_t, size_t) const { return 0; }
+    inline size_t get_type_count(size_t) const { return 0; }
+    inline size_t get_type_live(size_t) const { return 0; }
+    inline void record_latency(uint64_t, uint64_t) {}
+    inline void reset_latency() {}
+    inline size_t get_lock_uncontended() const { return 0; }
+    inline size_t get_lock_contended() const { return 0; }
+    inline uint64_t get_lock_wait_ns() const { return 0; }
+    inline void reset_contention() {}
+    inline const char* name() const { return "AllDomains"; }
+
+    /* nothing is counted, the quotas can't be checked */
+    enum QCENUM { max_quota_callbacks = 4 };
+    enum : size_t { no_quota = static_cast<size_t>(-1) };
+    inline void set_quota(size_t, size_t = no_quota) {}
+    inline size_t get_soft_quota() const { return no_quota; }
+    inline size_t get_hard_quota() const { return no_quota; }
+    inline bool add_quota_callback(nq::memlib::QuotaCallback) { return true; }
+    inline void remove_quota_callback(nq::memlib::QuotaCallback) {}
+    inline void set_quota_handler(nq::memlib::QuotaHandler) {}
+    inline void check_quota(size_t) {}
+
+    inline nq::memlib::TrackingLevel get_level() const
+    { return nq::memlib::track_off; }
+    inline void set_level(nq::memlib::TrackingLevel) {}
+    inline size_t get_sample_rate() const { return 1; }
+    inline void set_sample_rate(size_t) {}
+
+    inline void snapshot(std::vector<DomainSnapshot>&, size_t = 0) {}
+
+    template<class Fun>
+    void for_each(const Fun& fun) { fun(*this); }
+
+    inline BaseDomain* find(const char*) { return nullptr; }
 
     virtual std::tuple<int, int>
     get_node_infos() const override
     { return std::tuple<int, int>(0, 0); }
 protected:
     BaseDomain() {}
+    inline void init_from_env() {}
 };
 # endif // WITH_NQ_MEMLOG
 
 /*** Non-member functions ***/
 namespace nq { namespace memlib {
-    /* These non-members are (way) easier to pass as function pointers */
-    template<class Domain>
-    void remove_elem_domain(void *ptr)
+    /*
+    ** Recover the Domain logged in the SubHeader at internal_ptr and remove
+    ** the SubHeader from it (used by operator delete)
+    */
+    inline void remove_header_operator_delete(void *internal_ptr)
     {
-        Domain::getInstance().remove(ptr);
+# ifdef WITH_NQ_MEMLOG
+        BaseDomain::SubHeader *sub_header =
+            static_cast<BaseDomain::SubHeader*>(internal_ptr);
+        sub_header->get_domain()->remove(internal_ptr);
+# else // WITH_NQ_MEMLOG
+        (void)internal_ptr;
+# endif // !WITH_NQ_MEMLOG
     }
 
-    template<class Domain,
-        class... Args>
-    void add_elem_domain(Args... args)
+    /*
+    ** Retag to the Domain to the SubHeader at internal_ptr, whose Domain is
+    ** recovered from it (see BaseDomain::retag)
+    */
+    inline void retag_header_operator_delete(void *internal_ptr,
+            BaseDomain& to)
     {
-        Domain::getInstance().add(std::forward<Args>(args)...);
+# ifdef WITH_NQ_MEMLOG
+        BaseDomain::SubHeader *sub_header =
+            static_cast<BaseDomain::SubHeader*>(internal_ptr);
+        sub_header->get_domain()->retag(internal_ptr, to);
+# else // WITH_NQ_MEMLOG
+        (void)internal_ptr;
+        (void)to;
+# endif // !WITH_NQ_MEMLOG
     }
+
+    /*
+    ** Domain policy of the allocations whose Domain is only known at runtime
+    ** from their SubHeader (NQ_NEW, CurrentDomain...)
+    */
+    struct HeaderDomain
+    {
+        /* the Domain is only known at runtime, it isn't timed */
+        typedef DefaultDomainPolicy policy;
+
+        static HeaderDomain& getInstance()
+        {
+            static HeaderDomain instance;
+            return instance;
+        }
+
+        inline void remove(void *internal_ptr)
+        {
+            remove_header_operator_delete(internal_ptr);
+        }
+
+        inline void record_latency(uint64_t, uint64_t) {}
+    };
 }} // nq::memlib
 
 class AllDomains : public BaseDomain
 {
 public:
+    typedef nq::memlib::DefaultDomainPolicy policy;
+
     static AllDomains& getInstance()
     {
         static AllDomains instance;
         return instance;
     }
-# ifdef WITH_NQ_MEMLOG
-    virtual void virtual_remove(void *internal_ptr) override
+private:
+    AllDomains()
     {
-        this->remove(internal_ptr);
+        init_from_env();
     }
-# endif // !WITH_NQ_MEMLOG
 private:
     virtual const char* domain_name() const { return "AllDomains"; }
 };
 
+namespace nq { namespace memlib {
+    /* change the level of every Domain */
+    void set_tracking_level(TrackingLevel level);
+
+    /* change the level of the Domain named domain_name, false if not found */
+    bool set_tracking_level(const char* domain_name, TrackingLevel level);
+}} // nq::memlib
+
+/* compile time checks of a Domain policy */
+# define NQ_CHECK_DOMAIN_POLICY(domain_policy)  \
+    static_assert((domain_policy::alignment & (domain_policy::alignment - 1)) \
+            == 0, "Domain policy alignment is not a power of 2");\
+    static_assert(domain_policy::sample_rate > 0,\
+            "Domain policy sample_rate can't be 0");
+
 # ifdef WITH_NQ_MEMLOG
 
 /* Generic declaration of a Domain to avoid copy paste at every
  * new domain creation */
 #  define NQ_DOMAIN(new_domain, parent_domain) \
+    NQ_DOMAIN_EX(new_domain, parent_domain, nq::memlib::DefaultDomainPolicy)
+
+/* Declaration of a Domain with its own policy (see DefaultDomainPolicy) */
+#  define NQ_DOMAIN_EX(new_domain, parent_domain, domain_policy) \
 class new_domain : public BaseDomain           \
 {                                              \
 public:                                        \
+    typedef domain_policy policy;              \
+    NQ_CHECK_DOMAIN_POLICY(domain_policy)      \
+                                               \
     static new_domain& getInstance()           \
     {                                          \
         static new_domain instance;            \
-        parent_domain::getInstance().add_son(&instance);\
         return instance;                       \
     }                                          \
-    virtual void virtual_remove(void *internal_ptr) override\
+private:                                       \
+    new_domain()                               \
     {                                          \
-        this->remove(internal_ptr);            \
+        parent_domain::getInstance().add_son(this);\
+        set_level(static_cast<nq::memlib::TrackingLevel>(policy::level));\
+        set_sample_rate(policy::sample_rate);  \
+        set_profile_stats(policy::profile_stats != 0);\
+        set_thread_stats(policy::thread_stats != 0);\
+        init_from_env();                       \
     }                                          \
-private:                                       \
     virtual const char* domain_name() const { return #new_domain; } \
 };
 
@@ -260,6 +922,17 @@ private:                                       \
 # define NQ_DOMAIN(new_domain, unused_param) \
     typedef AllDomains new_domain;
 
+/*
+** A Domain with a policy keeps its own type so its AllocStrat and alignment
+** still apply, everything else is AllDomains.
+*/
+# define NQ_DOMAIN_EX(new_domain, unused_param, domain_policy) \
+struct new_domain : public AllDomains          \
+{                                              \
+    typedef domain_policy policy;              \
+    NQ_CHECK_DOMAIN_POLICY(domain_policy)      \
+};
+
 # endif // !WITH_NQ_MEMLOG
 
 #endif // !BASE_DOMAIN_H_
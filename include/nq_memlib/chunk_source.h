@@ -0,0 +1,73 @@
+#ifndef NQ_CHUNK_SOURCE_H_
+# define NQ_CHUNK_SOURCE_H_
+
+# include <cstddef>
+
+namespace nq { namespace memlib
+{
+    /*
+    ** The pages of a chunk: huge_pages are explicit huge pages, the kernel
+    ** was only advised to use transparent huge pages for advised_pages and
+    ** may back them with regular pages.
+    */
+    enum ChunkPages { regular_pages, huge_pages, advised_pages };
+
+    /*
+    ** A ChunkSource gives the big chunks of memory that the pool strategies
+    ** (PoolAlloc) carve into allocations:
+    **  -chunk_size: the chunks are aligned on it, and their sizes are
+    **   multiples of it
+    **  -static void* allocate_chunk(std::size_t size, int node,
+    **   ChunkPages& pages): the pages are preferably taken on the NUMA node
+    **   (any node when -1), pages is set to what backs the chunk
+    **  -static void deallocate_chunk(void *chunk, std::size_t size)
+    ** They return nullptr when out of memory.
+    */
+
+    /* chunks of regular pages */
+    struct PageSource
+    {
+        enum { chunk_size = 2 * 1024 * 1024 };
+
+        static void* allocate_chunk(std::size_t size, int node,
+                ChunkPages& pages);
+        static void deallocate_chunk(void *chunk, std::size_t size);
+    };
+
+    /*
+    ** chunks of 2 MiB pages: explicit ones (MAP_HUGETLB) when enabled,
+    ** otherwise transparent ones (madvise(MADV_HUGEPAGE), advised_pages).
+    ** Without any of them the chunks are regular pages.
+    */
+    struct HugePageSource
+    {
+        enum { chunk_size = 2 * 1024 * 1024 };
+
+        static void* allocate_chunk(std::size_t size, int node,
+                ChunkPages& pages);
+        static void deallocate_chunk(void *chunk, std::size_t size);
+    };
+
+    /*
+    ** Use the explicit huge pages (reserved in /proc/sys/vm/nr_hugepages),
+    ** off by default or set by the NQ_MEMLIB_HUGETLB environment variable
+    ** (0 or 1). HugePageSource falls back to transparent huge pages when
+    ** none is left.
+    */
+    void set_use_hugetlb(bool use);
+    bool get_use_hugetlb();
+
+    /*
+    ** Fault in every page of a chunk now (MADV_POPULATE_WRITE, or by
+    ** touching them) so its first use doesn't stall on page faults
+    */
+    void prefault_chunk(void *chunk, std::size_t size);
+
+    /*
+    ** mlock the pages of a chunk (which faults them in), false when refused
+    ** (RLIMIT_MEMLOCK...). deallocate_chunk unlocks them.
+    */
+    bool lock_chunk(void *chunk, std::size_t size);
+}} // namespace nq::memlib
+
+#endif // !NQ_CHUNK_SOURCE_H_
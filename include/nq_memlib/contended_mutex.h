@@ -0,0 +1,79 @@
+#ifndef NQ_CONTENDED_MUTEX_H_
+# define NQ_CONTENDED_MUTEX_H_
+
+# include <atomic>
+# include <cstddef>
+# include <cstdint>
+# include <mutex>
+
+# include "latency_histogram.h"
+
+namespace nq { namespace memlib
+{
+    /*
+    ** std::mutex counting its contention: lock() tries the lock first, the
+    ** acquisitions it gets right away only cost a relaxed increment, the
+    ** others also time their wait. It is the mutex of the Domains (see
+    ** BaseDomain::get_lock_contended), to find the ones to split.
+    */
+    class ContendedMutex
+    {
+    public:
+        ContendedMutex()
+            : uncontended_(0),
+            contended_(0),
+            wait_ns_(0)
+        {}
+
+        inline void lock()
+        {
+            if (mutex_.try_lock())
+            {
+                uncontended_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            const uint64_t start = memlib::latency_now();
+            mutex_.lock();
+            contended_.fetch_add(1, std::memory_order_relaxed);
+            wait_ns_.fetch_add(memlib::latency_now() - start,
+                    std::memory_order_relaxed);
+        }
+
+        inline bool try_lock()
+        {
+            return mutex_.try_lock();
+        }
+
+        inline void unlock()
+        {
+            mutex_.unlock();
+        }
+
+        /* acquisitions by lock() that didn't wait / waited */
+        inline size_t get_uncontended() const
+        { return uncontended_.load(std::memory_order_relaxed); }
+        inline size_t get_contended() const
+        { return contended_.load(std::memory_order_relaxed); }
+        /* total nanoseconds waited by the contended acquisitions */
+        inline uint64_t get_wait_ns() const
+        { return wait_ns_.load(std::memory_order_relaxed); }
+
+        inline void reset_contention()
+        {
+            uncontended_.store(0, std::memory_order_relaxed);
+            contended_.store(0, std::memory_order_relaxed);
+            wait_ns_.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        ContendedMutex(const ContendedMutex&);
+        ContendedMutex& operator=(const ContendedMutex&);
+
+        std::mutex mutex_;
+        std::atomic<size_t> uncontended_;
+        std::atomic<size_t> contended_;
+        std::atomic<uint64_t> wait_ns_;
+    };
+}} // namespace nq::memlib
+
+#endif // !NQ_CONTENDED_MUTEX_H_
@@ -0,0 +1,124 @@
+#ifndef CURRENT_DOMAIN_H_
+# define CURRENT_DOMAIN_H_
+
+# include "env_maccro.h"
+# include "lib_domains.h"
+
+/*
+** The current Domain is a thread-local Domain pushed by nq::domain_scope,
+** so allocations can be attributed without threading a Domain type through
+** every call.
+** Allocations logged in the CurrentDomain tag go to the current Domain of
+** the allocating thread (UnknownDomain if none), their Header keeps the
+** Domain so they can be freed from anywhere.
+*/
+
+namespace nq { namespace memlib {
+    /* the slot is a plain pointer, reading it is a single thread-local load */
+    inline BaseDomain*& current_domain_slot()
+    {
+        static NQ_THREAD_LOCAL BaseDomain *current = nullptr;
+        return current;
+    }
+
+    /* current Domain of the thread, nullptr outside of any domain_scope */
+    inline BaseDomain* current_domain()
+    {
+        return current_domain_slot();
+    }
+}} // namespace nq::memlib
+
+# ifdef WITH_NQ_MEMLOG
+class CurrentDomain
+{
+public:
+    typedef nq::memlib::DefaultDomainPolicy policy;
+
+    /* the Domain is recovered from the Header, it needs a SubHeader */
+    enum HSENUM { header_size = BaseDomain::sub_header_size,
+        sub_header_size = BaseDomain::sub_header_size };
+
+    static CurrentDomain& getInstance()
+    {
+        static CurrentDomain instance;
+        return instance;
+    }
+
+    /* Domain receiving the allocations of the thread right now */
+    static BaseDomain& get()
+    {
+        BaseDomain *dom = nq::memlib::current_domain();
+        if (dom != nullptr)
+            return *dom;
+        return UnknownDomain::getInstance();
+    }
+
+    /* the policy has no type_stats, the type is always 0 */
+    inline void add(void *internal_ptr, size_t size, size_t backing = 0,
+            size_t = 0)
+    {
+        BaseDomain& dom = get();
+        dom.add(internal_ptr, size, nullptr, 0, &dom, backing);
+    }
+
+    inline void add(void *internal_ptr, size_t size,
+            const char* file, size_t line, CurrentDomain*, size_t backing = 0)
+    {
+        BaseDomain& dom = get();
+        dom.add(internal_ptr, size, file, line, &dom, backing);
+    }
+
+    inline void check_quota(size_t size)
+    {
+        get().check_quota(size);
+    }
+
+    inline void record_latency(uint64_t strategy_ns, uint64_t domain_ns)
+    {
+        get().record_latency(strategy_ns, domain_ns);
+    }
+
+    /* the Header may belong to another Domain than the current one */
+    inline void remove(void *internal_ptr)
+    {
+        nq::memlib::HeaderDomain::getInstance().remove(internal_ptr);
+    }
+};
+
+# else // WITH_NQ_MEMLOG
+/* If not logging the current Domain is AllDomains, like any other Domain */
+typedef AllDomains CurrentDomain;
+# endif // !WITH_NQ_MEMLOG
+
+namespace nq
+{
+    /*
+    ** RAII setting the current Domain of the thread to Domain for its
+    ** lifetime, scopes can be nested.
+    ** eg: nq::domain_scope<RenderDomain> scope;
+    **     nq::vector<Vertex, CurrentDomain> vertices; // logged in RenderDomain
+    */
+    template<class Domain>
+    class domain_scope
+    {
+    public:
+        domain_scope()
+            : previous_(memlib::current_domain_slot())
+        { // push Domain as the current Domain
+            memlib::current_domain_slot() = &Domain::getInstance();
+        }
+
+        ~domain_scope()
+        { // pop Domain
+            memlib::current_domain_slot() = previous_;
+        }
+
+    private:
+        domain_scope(const domain_scope&);
+        domain_scope& operator=(const domain_scope&);
+
+        BaseDomain *previous_;
+    };
+} // namespace nq
+
+#endif // !CURRENT_DOMAIN_H_
@@ -0,0 +1,99 @@
+#ifndef NQ_EMERGENCY_RESERVE_H_
+# define NQ_EMERGENCY_RESERVE_H_
+
+# include <atomic>
+# include <cstddef>
+# include <mutex>
+# include <new>
+# include <type_traits>
+
+namespace nq { namespace memlib
+{
+    /*
+    ** EmergencyReserve holds memory taken (and faulted in) up front, for
+    ** the Domains whose policy has an emergency_reserve: their allocations
+    ** come from it only when their AllocStrat fails, and raise a memory
+    ** pressure event (see request_memory_pressure). Once the AllocStrat
+    ** gives memory again the reserve is refilled with a new region, so a
+    ** critical Domain keeps running through a spike instead of throwing.
+    ** It is a first fit allocator, it is only used in emergencies.
+    ** A reserve is never destroyed (deallocate_any walks all of them), get
+    ** it through emergency_reserve<Domain>.
+    */
+    class EmergencyReserve
+    {
+    public:
+        explicit EmergencyReserve(std::size_t size);
+
+        /* nullptr when the reserve is exhausted */
+        void* allocate(std::size_t size, std::size_t align) noexcept;
+        /* false if ptr doesn't come from the reserve */
+        bool deallocate(void *ptr);
+        bool owns(const void *ptr) const;
+
+        /*
+        ** less than the reserved size is free (some of it is in use) and a
+        ** region can still be added: once max_regions are mapped the
+        ** reserve only gets back what is freed in it
+        */
+        inline bool needs_refill() const
+        {
+            return get_free_size() < size_
+                && nb_regions_.load(std::memory_order_relaxed) < max_regions;
+        }
+        /* map a region for the part in use, false if it can't */
+        bool refill();
+
+        inline std::size_t get_size() const
+        { return size_; }
+        inline std::size_t get_free_size() const
+        { return free_size_.load(std::memory_order_relaxed); }
+
+        /* deallocate ptr in the reserve owning it, false if none does */
+        static bool deallocate_any(void *ptr);
+        /* false until a reserve is created, the frees skip deallocate_any */
+        static inline bool any_reserve()
+        { return any_reserve_.load(std::memory_order_acquire); }
+
+    public:
+        enum { max_regions = 8 };
+
+    private:
+        struct FreeBlock;
+        struct Region
+        {
+            char *begin_;
+            char *end_;
+            FreeBlock *free_; // sorted by address
+        };
+
+        bool add_region(std::size_t size);
+        void* allocate_in(Region& region, std::size_t size,
+                std::size_t align);
+        void deallocate_in(Region& region, void *ptr);
+
+    private:
+        const std::size_t size_;
+        std::mutex mutex_;
+        Region regions_[max_regions];
+        std::atomic<std::size_t> nb_regions_;
+        std::atomic<std::size_t> free_size_;
+        EmergencyReserve *next_reserve_; // every reserve, for deallocate_any
+
+        static std::atomic<bool> any_reserve_;
+    };
+
+    /* the EmergencyReserve of Domain, created at its first use */
+    template<class Domain>
+    EmergencyReserve& emergency_reserve()
+    {
+        /* never destroyed: static objects may still free in it at exit */
+        static typename std::aligned_storage<sizeof (EmergencyReserve),
+               alignof(EmergencyReserve)>::type storage;
+        static EmergencyReserve *reserve = new (&storage)
+            EmergencyReserve(Domain::policy::emergency_reserve);
+        return *reserve;
+    }
+}} // namespace nq::memlib
+
+#endif // !NQ_EMERGENCY_RESERVE_H_
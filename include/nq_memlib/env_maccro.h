@@ -50,4 +50,11 @@
 #  define noexcept
 # endif // !NQ_WIN_
 
+/* thread_local is not implemented by every supported compiler */
+# ifdef NQ_WIN_
+#  define NQ_THREAD_LOCAL __declspec(thread)
+# else // NQ_WIN_
+#  define NQ_THREAD_LOCAL __thread
+# endif // !NQ_WIN_
+
 #endif // !ENV_MACCRO_H_
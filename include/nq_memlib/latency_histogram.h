@@ -0,0 +1,80 @@
+#ifndef NQ_LATENCY_HISTOGRAM_H_
+# define NQ_LATENCY_HISTOGRAM_H_
+
+# include <atomic>
+# include <chrono>
+# include <cstddef>
+# include <cstdint>
+
+# include "env_maccro.h"
+
+namespace nq { namespace memlib
+{
+    /* count and percentiles of a LatencyHistogram, in nanoseconds */
+    struct LatencySnapshot
+    {
+        size_t count;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t p999;
+    };
+
+    /*
+    ** Histogram of durations in nanoseconds, one bucket per power of 2 so
+    ** recording is a bit scan and a relaxed increment. The percentiles are
+    ** the upper bound of their bucket: at most twice the real value.
+    */
+    class LatencyHistogram
+    {
+    public:
+        enum { nb_buckets = 40 }; // up to 2^39 ns, about 9 minutes
+
+        LatencyHistogram()
+        {
+            reset();
+        }
+
+        inline void record(uint64_t ns)
+        {
+            buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /* upper bound of the duration of the q (0 to 1) quantile, 0 if empty */
+        uint64_t percentile(double q) const;
+        size_t count() const;
+        LatencySnapshot snapshot() const;
+        void reset();
+
+        static inline size_t bucket_of(uint64_t ns)
+        {
+            if (ns == 0)
+                return 0;
+# ifdef NQ_GNU_
+            size_t bits = 64 - __builtin_clzll(ns);
+# else // NQ_GNU_
+            size_t bits = 0;
+            for (uint64_t rest = ns; rest != 0; rest >>= 1)
+                ++bits;
+# endif // !NQ_GNU_
+            return bits < nb_buckets ? bits : nb_buckets - 1;
+        }
+
+    private:
+        LatencyHistogram(const LatencyHistogram&);
+        LatencyHistogram& operator=(const LatencyHistogram&);
+
+        /* bucket b holds the durations in [2^(b-1), 2^b) */
+        std::atomic<size_t> buckets_[nb_buckets];
+    };
+
+    /* the clock of the latency stats (see the latency_stats policy) */
+    inline uint64_t latency_now()
+    {
+        return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+    }
+}} // namespace nq::memlib
+
+#endif // !NQ_LATENCY_HISTOGRAM_H_
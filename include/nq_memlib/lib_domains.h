@@ -6,5 +6,10 @@
 /* Library defined domains */
 NQ_DOMAIN(UnknownDomain, AllDomains);
 NQ_DOMAIN(SharedPtrRefCountDomain, AllDomains);
+/* malloc calls caught by the preload shim (libnq_memlib_preload.so) */
+NQ_DOMAIN(ExternalDomain, AllDomains);
+
+/* CurrentDomain, the thread-local Domain set by nq::domain_scope */
+# include "current_domain.h"
 
 #endif // !LIB_DOMAINS_H_
@@ -0,0 +1,104 @@
+#ifndef NQ_MMAP_ALLOC_H_
+# define NQ_MMAP_ALLOC_H_
+
+# include <cstddef>
+
+# include "alloc_strat.h"
+# include "env_maccro.h"
+
+# ifndef NQ_WIN_
+#  include <sys/mman.h>
+#  include <unistd.h>
+# endif // !NQ_WIN_
+
+# ifndef NQ_WIN_
+/*
+** MmapAlloc maps the allocations of at least Threshold bytes straight from
+** mmap and gives them back with munmap, the smaller ones use DefaultAlloc.
+** Its reallocate grows a mapping with mremap (Linux), so the arrays
+** resized with memlib::reallocate_log (nq::raw_vector growth) move their
+** pages, not their bytes.
+** It needs the allocation size to deallocate: it can't be used by NQ_NEW.
+*/
+template<std::size_t Threshold = (1 << 20)>
+struct MmapAlloc
+{
+    static std::size_t page_size()
+    {
+        static const std::size_t size = sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    /* size rounded up to a whole number of pages */
+    static std::size_t map_size(std::size_t size)
+    {
+        return (size + page_size() - 1) & ~(page_size() - 1);
+    }
+
+    void* allocate(std::size_t size)
+    {
+        if (size < Threshold)
+            return DefaultAlloc().allocate(size);
+
+        void *ptr = mmap(nullptr, map_size(size), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        if (size < Threshold)
+            return DefaultAlloc().allocate(size, align);
+        if (align <= page_size())
+            return allocate(size);
+
+        /* map align more bytes and unmap what is around the aligned part */
+        const std::size_t length = map_size(size);
+        char *ptr = static_cast<char*>(allocate(length + align));
+        if (ptr == nullptr)
+            return nullptr;
+        char *aligned = reinterpret_cast<char*>(
+                (reinterpret_cast<std::size_t>(ptr) + align - 1)
+                & ~(align - 1));
+        if (aligned != ptr)
+            munmap(ptr, aligned - ptr);
+        munmap(aligned + length, ptr + align - aligned);
+        return aligned;
+    }
+
+    void deallocate(void *ptr, std::size_t size)
+    {
+        if (size < Threshold)
+            DefaultAlloc().deallocate(ptr, size);
+        else
+            munmap(ptr, map_size(size));
+    }
+
+#  ifdef __linux__
+    /*
+    ** Grow or shrink the mapping at ptr in place or by moving its pages,
+    ** nullptr when it isn't a mapping or can't be remapped (the caller
+    ** then allocates, copies and deallocates).
+    */
+    void* reallocate(void *ptr, std::size_t old_size, std::size_t new_size,
+            std::size_t align)
+    {
+        if (old_size < Threshold || new_size < Threshold
+                || align > page_size())
+            return nullptr;
+
+        void *new_ptr = mremap(ptr, map_size(old_size), map_size(new_size),
+                MREMAP_MAYMOVE);
+        return new_ptr == MAP_FAILED ? nullptr : new_ptr;
+    }
+#  endif // !__linux__
+};
+
+# else // NQ_WIN_
+/* no mmap on Windows, MmapAlloc is DefaultAlloc */
+template<std::size_t Threshold = (1 << 20)>
+struct MmapAlloc : DefaultAlloc
+{};
+# endif // !NQ_WIN_
+
+#endif // !NQ_MMAP_ALLOC_H_
@@ -0,0 +1,132 @@
+#ifndef NQ_NO_ALLOC_SCOPE_H_
+# define NQ_NO_ALLOC_SCOPE_H_
+
+# include <atomic>
+# include <cassert>
+# include <cstddef>
+
+# include "env_maccro.h"
+
+/*
+** nq::no_alloc_scope marks a region of a thread that must not allocate
+** (a tick loop...). Every allocation reaching an AllocStrat through the
+** memlib (allocate_log, the global operator new, the preload shim...)
+** checks the thread-local state below: outside of any scope it is a
+** single thread-local load.
+** An allocation inside a scope is counted, then calls the no_alloc
+** handler, or asserts when there is none (so only without NDEBUG): the
+** counts stay available as metrics in release builds.
+*/
+
+namespace nq { namespace memlib {
+    /* what the allocations of the thread did inside the no_alloc_scopes */
+    struct NoAllocState
+    {
+        size_t depth; // number of nested no_alloc_scope
+        size_t count;
+        size_t size;
+    };
+
+    /* the state is plain data, it is zero initialized without TLS ctor */
+    inline NoAllocState& no_alloc_state()
+    {
+        static NQ_THREAD_LOCAL NoAllocState state;
+        return state;
+    }
+
+    /* called with the size of an allocation made in a no_alloc_scope */
+    typedef void (*NoAllocHandler)(size_t size);
+
+    inline std::atomic<NoAllocHandler>& no_alloc_handler_slot()
+    {
+        static std::atomic<NoAllocHandler> handler(nullptr);
+        return handler;
+    }
+
+    /* nullptr to assert again */
+    inline void set_no_alloc_handler(NoAllocHandler handler)
+    {
+        no_alloc_handler_slot().store(handler, std::memory_order_relaxed);
+    }
+
+    /* allocations made in a no_alloc_scope by every thread, since start */
+    inline std::atomic<size_t>& no_alloc_total_slot()
+    {
+        static std::atomic<size_t> total(0);
+        return total;
+    }
+
+    inline size_t get_no_alloc_total()
+    {
+        return no_alloc_total_slot().load(std::memory_order_relaxed);
+    }
+
+    inline void no_alloc_violation(NoAllocState& state, size_t size)
+    {
+        ++state.count;
+        state.size += size;
+        no_alloc_total_slot().fetch_add(1, std::memory_order_relaxed);
+
+        NoAllocHandler handler =
+            no_alloc_handler_slot().load(std::memory_order_relaxed);
+        assert((handler != nullptr)
+                && "Allocation inside an nq::no_alloc_scope");
+        if (handler != nullptr)
+        {
+            /* the handler may allocate (to log...) */
+            const size_t depth = state.depth;
+            state.depth = 0;
+            handler(size);
+            state.depth = depth;
+        }
+    }
+
+    /* called by every allocation of size bytes */
+    inline void no_alloc_check(size_t size)
+    {
+        NoAllocState& state = no_alloc_state();
+        if (state.depth != 0)
+            no_alloc_violation(state, size);
+    }
+}} // namespace nq::memlib
+
+namespace nq
+{
+    /*
+    ** RAII forbidding the allocations of the thread for its lifetime,
+    ** scopes can be nested.
+    ** eg: nq::no_alloc_scope guard;
+    **     world.tick(); // asserts if it allocates
+    **     ticks_allocations.add(guard.count());
+    */
+    class no_alloc_scope
+    {
+    public:
+        no_alloc_scope()
+            : count_(memlib::no_alloc_state().count),
+            size_(memlib::no_alloc_state().size)
+        {
+            ++memlib::no_alloc_state().depth;
+        }
+
+        ~no_alloc_scope()
+        {
+            --memlib::no_alloc_state().depth;
+        }
+
+        /* allocations made since the scope began, nested scopes included */
+        size_t count() const
+        { return memlib::no_alloc_state().count - count_; }
+        size_t size() const
+        { return memlib::no_alloc_state().size - size_; }
+
+    private:
+        no_alloc_scope(const no_alloc_scope&);
+        no_alloc_scope& operator=(const no_alloc_scope&);
+
+        size_t count_;
+        size_t size_;
+    };
+} // namespace nq
+
+#endif // !NQ_NO_ALLOC_SCOPE_H_
@@ -4,6 +4,7 @@
 # include <cassert>
 # include <limits>
 # include <memory>
+# include <type_traits>
 
 # include "nq_memlib_tools.h"
 # include "nq_memlib_allocate.h"
@@ -19,7 +20,7 @@ namespace nq
 {
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     struct allocator
     {
         /* Member types */
@@ -40,20 +41,32 @@ namespace nq
 
         /* constructors */
         explicit allocator() {}
-        allocator(const allocator&) {}
+        allocator(const allocator& other)
+            : strat_(other.strat_)
+        {}
+
+        /* allocator using the AllocStrat instance strat (NumaAlloc node...) */
+        explicit allocator(const AllocStrat& strat)
+            : strat_(strat)
+        {}
 
         template <class U>
-            allocator(const allocator<U, Domain, AllocStrat>&) {}
+            allocator(const allocator<U, Domain, AllocStrat>& other)
+            : strat_(other.strategy())
+        {}
 
         template<class U>
-        allocator& operator=(const allocator<U, Domain, AllocStrat>&)
-        { return *this; }
+        allocator& operator=(const allocator<U, Domain, AllocStrat>& other)
+        { strat_ = other.strategy(); return *this; }
 
         allocator& operator=(const allocator& other)
-        { return *this; }
+        { strat_ = other.strat_; return *this; }
 
         ~allocator() {};
 
+        const AllocStrat& strategy() const
+        { return strat_; }
+
         /* Adress */
         pointer adress(reference r) const
         { return &r; }
@@ -64,15 +77,14 @@ namespace nq
         pointer allocate(size_type count,
                 std::allocator<void>::const_pointer = 0)
         { // allocate memory with alloc_strat
-            return memlib::allocate_log<T, Domain, AllocStrat>(count,
+            return memlib::allocate_log<T, Domain>(strat_, count,
                                                     Domain::header_size);
         }
 
-        void deallocate(pointer usr_ptr, size_type)
-        { // deallocate memory pointer by usr_ptr with alloc_strat
-            memlib::deallocate_log<AllocStrat>(usr_ptr, Domain::header_size,
-                    memlib::remove_elem_domain<Domain>);
-            /* size_type ? */
+        void deallocate(pointer usr_ptr, size_type count)
+        { // deallocate the count elements at usr_ptr with alloc_strat
+            memlib::deallocate_log<T, Domain>(strat_, usr_ptr, count,
+                    Domain::header_size);
         }
 
         size_type max_size() const
@@ -98,24 +110,35 @@ namespace nq
         {
             memlib::destroy(ptr);
         }
+
+    private:
+        AllocStrat strat_;
     };
 
+    /*
+    ** The allocators sharing an AllocStrat compare equal: its instances
+    ** must deallocate the memory of each other.
+    */
     template<class T1,
         class Domain1,
+        class AllocStrat1,
         class T2,
-        class Domain2>
-    bool operator==(const allocator<T1, Domain1>& lhs,
-            const allocator<T2, Domain2>& rhs)
+        class Domain2,
+        class AllocStrat2>
+    bool operator==(const allocator<T1, Domain1, AllocStrat1>&,
+            const allocator<T2, Domain2, AllocStrat2>&)
     {
-        return true;
+        return std::is_same<AllocStrat1, AllocStrat2>::value;
     }
 
     template<class T1,
         class Domain1,
+        class AllocStrat1,
         class T2,
-        class Domain2>
-    bool operator!=(const allocator<T1, Domain1>& lhs,
-            const allocator<T2, Domain2>& rhs)
+        class Domain2,
+        class AllocStrat2>
+    bool operator!=(const allocator<T1, Domain1, AllocStrat1>& lhs,
+            const allocator<T2, Domain2, AllocStrat2>& rhs)
     {
         return !operator==(lhs, rhs);
     }
@@ -127,7 +150,7 @@ namespace nq
 {
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     using allocator = std::allocator<T>;
 }
 # endif // !WITH_NQ_MEMOFF
@@ -0,0 +1,109 @@
+#ifndef NQ_CGROUP_H_
+# define NQ_CGROUP_H_
+
+# include <chrono>
+# include <cstddef>
+# include <string>
+
+/*
+** Memory budgets from the cgroup (v2) of the process: its memory.max and
+** memory.high give the limit the Domains budgets and the pools size are
+** derived from, and memory.current tells when the process comes close to
+** it. Under pressure the pools give their free chunks back and the
+** registered callbacks are called, before the OOM killer does anything.
+*/
+
+namespace nq { namespace memlib {
+    /* value of a cgroup file set to "max" */
+    const size_t no_cgroup_limit = static_cast<size_t>(-1);
+
+    /* the cgroup memory files, in bytes */
+    struct CgroupMemory
+    {
+        size_t max; // memory.max
+        size_t high; // memory.high (throttling starts there)
+        size_t current; // memory.current
+
+        /* the one the usage must stay under */
+        size_t limit() const { return high < max ? high : max; }
+    };
+
+    /*
+    ** Directory of the cgroup files: NQ_MEMLIB_CGROUP, or the cgroup of the
+    ** process under /sys/fs/cgroup (read from /proc/self/cgroup)
+    */
+    void set_cgroup_path(const std::string& dirpath);
+    std::string get_cgroup_path();
+
+    /* false when memory.max or memory.current can't be read (no cgroup v2) */
+    bool read_cgroup_memory(CgroupMemory& memory);
+
+    /*
+    ** The Domain named domain_name gets share (0 to 1) of the cgroup limit
+    ** as its soft quota, and hard_share of it as its hard quota (see
+    ** BaseDomain::set_quota, 0 for none). The quotas follow the limit: they
+    ** are set again by every check_memory_pressure, and set to no_quota
+    ** without share or limit.
+    ** get_domain_budget returns the soft one in bytes (0 without share or
+    ** limit) and over_budget tells if the Domain holds more.
+    */
+    void set_domain_budget(const char* domain_name, double share,
+            double hard_share = 0);
+    size_t get_domain_budget(const char* domain_name);
+    bool over_budget(const char* domain_name);
+
+    /*
+    ** The SlabPools together hold at most share of the cgroup limit: above
+    ** it check_memory_pressure trims them down to it even without pressure,
+    ** their reserved chunks kept
+    */
+    void set_pool_cache_share(double share);
+    size_t get_pool_cache_limit();
+
+    struct MemoryPressure
+    {
+        CgroupMemory memory;
+        double usage; // memory.current / limit
+        size_t trimmed; // bytes the pools gave back
+    };
+
+    typedef void (*PressureCallback)(const MemoryPressure& pressure);
+
+    /* called from check_memory_pressure, so from the pressure thread */
+    void add_pressure_callback(PressureCallback callback);
+    void remove_pressure_callback(PressureCallback callback);
+
+    /* usage of the limit from which the process is under pressure (0.9) */
+    void set_pressure_threshold(double usage);
+
+    /*
+    ** Read the cgroup, set the Domains quotas from their budgets, and when
+    ** the usage reaches the pressure threshold,
+    ** trim every SlabPool then call the pressure callbacks. A pending
+    ** request_memory_pressure is served first, by notify_memory_pressure.
+    ** Return true if the process was under pressure.
+    */
+    bool check_memory_pressure();
+
+    /*
+    ** Trim every SlabPool then call the pressure callbacks, whatever the
+    ** usage of the cgroup
+    */
+    void notify_memory_pressure();
+
+    /*
+    ** An allocation failed (see EmergencyReserve): have the pressure thread
+    ** (or the next check_memory_pressure) call notify_memory_pressure. It
+    ** never blocks nor throws, so it can be called on allocation paths.
+    */
+    void request_memory_pressure() noexcept;
+
+    /*
+    ** Start the pressure thread calling check_memory_pressure every period.
+    ** Return false if the thread could not be started (or already runs).
+    */
+    bool start_pressure_thread(std::chrono::milliseconds period);
+    void stop_pressure_thread();
+}} // namespace nq::memlib
+
+#endif // !NQ_CGROUP_H_
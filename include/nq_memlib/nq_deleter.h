@@ -20,7 +20,7 @@ namespace nq
 {
     template <typename T,
         typename Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     struct deleter
     {
         deleter()
@@ -38,7 +38,7 @@ namespace nq
 
         void operator()(T *ptr) const
         { //delete the ptr with allocstrat
-            allocator<T, Domain, AllocStrat>().deallocate(ptr, 0);
+            memlib::Delete<T, Domain, AllocStrat>(ptr);
         }
     };
 
@@ -150,7 +150,7 @@ namespace nq
 {
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     using deleter = std::default_delete<T>;
 
     template<class T>
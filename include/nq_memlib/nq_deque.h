@@ -11,7 +11,7 @@ namespace nq
 {
     template<typename T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     class deque : public std::deque<T, nq::allocator<T, Domain, AllocStrat>>
     {
         typedef nq::allocator<T, Domain, AllocStrat> nq_alloc;
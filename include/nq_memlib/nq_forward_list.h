@@ -11,7 +11,7 @@ namespace nq
 {
     template<typename T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     class forward_list
     : public std::forward_list<T, nq::allocator<T, Domain, AllocStrat>>
     {
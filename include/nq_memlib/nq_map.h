@@ -12,7 +12,7 @@ namespace nq
     template<class Key,
         class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class Compare = std::less<Key>>
     class map
         : public std::map<const Key, T, Compare,
@@ -2,15 +2,233 @@
 # define NQ_MEMLIB_ALLOCATE_H_
 
 # include <memory>
+# include <cstddef>
+# include <cassert>
+# include <type_traits>
 
 # include "alloc_strat.h"
+# include "no_alloc_scope.h"
 
 namespace nq { namespace memlib
 {
+    /* alignment of the memory given by every AllocStrat::allocate(size) */
+    enum { default_alignment = alignof(std::max_align_t) };
+
+    /* true when AllocStrat has the aligned allocate(size, align) */
+    template<class AllocStrat,
+        class = void>
+    struct has_aligned_allocate : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_aligned_allocate<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().allocate(
+                        std::size_t(), std::size_t())))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    void* strat_allocate(AllocStrat& strat, size_t size, size_t align,
+            std::true_type)
+    {
+        return strat.allocate(size, align);
+    }
+
+    template<class AllocStrat>
+    void* strat_allocate(AllocStrat& strat, size_t size, size_t align,
+            std::false_type)
+    {
+        assert(align <= default_alignment
+                && "This AllocStrat can't allocate over-aligned memory");
+        (void)align;
+        return strat.allocate(size);
+    }
+
+    template<class AllocStrat>
+    void* allocate_aligned(AllocStrat& strat, size_t size, size_t align)
+    { // allocate size bytes aligned on align with strat
+        memlib::no_alloc_check(size);
+        return memlib::strat_allocate(strat, size, align,
+                has_aligned_allocate<AllocStrat>());
+    }
+
+    template<class AllocStrat = DefaultAlloc>
+    void* allocate_aligned(size_t size, size_t align)
+    { // allocate size bytes aligned on align with AllocStrat
+        AllocStrat strat;
+        return memlib::allocate_aligned(strat, size, align);
+    }
+
+    /* true when AllocStrat has bool huge_backed(const void *ptr) */
+    template<class AllocStrat,
+        class = void>
+    struct has_huge_backed : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_huge_backed<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().huge_backed(nullptr)))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    bool strat_huge_backed(AllocStrat& strat, const void *ptr, std::true_type)
+    {
+        return strat.huge_backed(ptr);
+    }
+
+    template<class AllocStrat>
+    bool strat_huge_backed(AllocStrat&, const void*, std::false_type)
+    {
+        return false;
+    }
+
+    template<class AllocStrat>
+    bool huge_backed(AllocStrat& strat, const void *ptr)
+    { // true if strat gave ptr from huge pages
+        return memlib::strat_huge_backed(strat, ptr,
+                has_huge_backed<AllocStrat>());
+    }
+
+    /* true when AllocStrat has bool prefaulted(const void *ptr) */
+    template<class AllocStrat,
+        class = void>
+    struct has_prefaulted : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_prefaulted<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().prefaulted(nullptr)))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    bool strat_prefaulted(AllocStrat& strat, const void *ptr, std::true_type)
+    {
+        return strat.prefaulted(ptr);
+    }
+
+    template<class AllocStrat>
+    bool strat_prefaulted(AllocStrat&, const void*, std::false_type)
+    {
+        return false;
+    }
+
+    template<class AllocStrat>
+    bool prefaulted(AllocStrat& strat, const void *ptr)
+    { // true if strat gave ptr from pages faulted in beforehand
+        return memlib::strat_prefaulted(strat, ptr,
+                has_prefaulted<AllocStrat>());
+    }
+
+    /* true when AllocStrat has size_t reserve(size_t size) */
+    template<class AllocStrat,
+        class = void>
+    struct has_reserve : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_reserve<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().reserve(std::size_t())))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    size_t strat_reserve(AllocStrat& strat, size_t size, std::true_type)
+    {
+        return strat.reserve(size);
+    }
+
+    template<class AllocStrat>
+    size_t strat_reserve(AllocStrat&, size_t, std::false_type)
+    {
+        return 0;
+    }
+
+    template<class AllocStrat>
+    size_t reserve(AllocStrat& strat, size_t size)
+    { // bytes strat took up front for the next allocations, 0 if it can't
+        return memlib::strat_reserve(strat, size, has_reserve<AllocStrat>());
+    }
+
+    /* true when AllocStrat has size_t trim(size_t target) */
+    template<class AllocStrat,
+        class = void>
+    struct has_trim : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_trim<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().trim(std::size_t())))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    size_t strat_trim(AllocStrat& strat, size_t target, std::true_type)
+    {
+        return strat.trim(target);
+    }
+
+    template<class AllocStrat>
+    size_t strat_trim(AllocStrat&, size_t, std::false_type)
+    {
+        return 0;
+    }
+
+    /*
+    ** Give the idle memory of strat back to the OS until it holds at most
+    ** target bytes (the free chunks of the pools). Returns the bytes given
+    ** back, 0 for the AllocStrats without trim(size_t target).
+    */
+    template<class AllocStrat>
+    size_t trim(AllocStrat& strat, size_t target = 0)
+    {
+        return memlib::strat_trim(strat, target, has_trim<AllocStrat>());
+    }
+
+    /* true when AllocStrat has reallocate(ptr, old_size, new_size, align) */
+    template<class AllocStrat,
+        class = void>
+    struct has_reallocate : std::false_type
+    {};
+
+    template<class AllocStrat>
+    struct has_reallocate<AllocStrat,
+        decltype(void(std::declval<AllocStrat&>().reallocate(
+                        nullptr, std::size_t(), std::size_t(),
+                        std::size_t())))>
+        : std::true_type
+    {};
+
+    template<class AllocStrat>
+    void* strat_reallocate(AllocStrat& strat, void *ptr, size_t old_size,
+            size_t new_size, size_t align, std::true_type)
+    {
+        return strat.reallocate(ptr, old_size, new_size, align);
+    }
+
+    template<class AllocStrat>
+    void* strat_reallocate(AllocStrat&, void*, size_t, size_t, size_t,
+            std::false_type)
+    {
+        return nullptr;
+    }
+
+    template<class AllocStrat>
+    void* reallocate(AllocStrat& strat, void *ptr, size_t old_size,
+            size_t new_size, size_t align)
+    { // resize with strat the memory at ptr, nullptr if it can't
+        if (new_size > old_size)
+            memlib::no_alloc_check(new_size - old_size);
+        return memlib::strat_reallocate(strat, ptr, old_size, new_size,
+                align, has_reallocate<AllocStrat>());
+    }
+
     template<class T,
         class AllocStrat = DefaultAlloc>
     T* allocate(size_t nb_elmt, size_t headers = 0)
     { // allocate nb_elmt * sizeof (T) memory and return a new pointer
+        memlib::no_alloc_check(nb_elmt * sizeof (T) + headers);
         void *inter_ptr = AllocStrat().allocate(nb_elmt * sizeof (T) + headers);
         return static_cast<T*>(inter_ptr);
     }
@@ -20,6 +238,33 @@ namespace nq { namespace memlib
     { // deallocate with AllocStrat memory at ptr
         AllocStrat().deallocate(ptr);
     }
+
+    /* Calls the sized AllocStrat::deallocate when the strategy has one */
+    template<class AllocStrat>
+    auto deallocate_sized(AllocStrat& strat, void *ptr, size_t size, int)
+        -> decltype(strat.deallocate(ptr, size))
+    {
+        return strat.deallocate(ptr, size);
+    }
+
+    template<class AllocStrat>
+    void deallocate_sized(AllocStrat& strat, void *ptr, size_t, long)
+    {
+        strat.deallocate(ptr);
+    }
+
+    template<class AllocStrat>
+    void deallocate(AllocStrat& strat, void *ptr, size_t size)
+    { // deallocate with strat memory of size bytes at ptr
+        memlib::deallocate_sized(strat, ptr, size, 0);
+    }
+
+    template<class AllocStrat = DefaultAlloc>
+    void deallocate(void *ptr, size_t size)
+    { // deallocate with AllocStrat memory of size bytes at ptr
+        AllocStrat strat;
+        memlib::deallocate(strat, ptr, size);
+    }
 }} // namespace nq::memlib
 
 #endif // NQ_MEMLIB_ALLOCATE_H_
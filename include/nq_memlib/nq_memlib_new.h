@@ -30,7 +30,7 @@ namespace nq { namespace memlib
     */
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc,
+         class AllocStrat = memlib::domain_alloc_strat<Domain>,
          class... Args>
     T* New(Args... args)
     {
@@ -42,12 +42,12 @@ namespace nq { namespace memlib
 
     template <class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     void Delete(T *ptr)
     {
         memlib::destroy(ptr);
-        memlib::deallocate_log<AllocStrat>(ptr, Domain::header_size,
-                memlib::remove_elem_domain<Domain>);
+        memlib::deallocate_log<T, Domain, AllocStrat>(ptr, 1,
+                Domain::header_size);
     }
 
     /* The ArrayHeader is used by New_array and Delete_array */
@@ -57,11 +57,11 @@ namespace nq { namespace memlib
             : count_(0)
         {}
 
-        ArrayHeader(std::uint32_t size)
+        ArrayHeader(std::size_t size)
             : count_(size)
         {}
 
-        std::uint32_t count_;
+        std::size_t count_;
     };
 
     /*
@@ -70,7 +70,7 @@ namespace nq { namespace memlib
     */
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc>
+         class AllocStrat = memlib::domain_alloc_strat<Domain>>
     T* New_array(std::size_t count, std::initializer_list<T> ilist = {})
     { // allocate a raw memory of size count initialized with ilist
         assert(ilist.size() <= count &&
@@ -98,7 +98,7 @@ namespace nq { namespace memlib
     /* Delete_array delete an array allocated with New_array */
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc>
+         class AllocStrat = memlib::domain_alloc_strat<Domain>>
     void Delete_array(T *usr_ptr)
     {
         if (usr_ptr != nullptr)
@@ -107,15 +107,13 @@ namespace nq { namespace memlib
             ** Recover the number of elements to be destroyed in the
             ** ArrayHeader and use it to call destroy_from_range
             */
-            {
-                ArrayHeader *array_ptr = reinterpret_cast<ArrayHeader*>(
-                        get_internal_ptr(usr_ptr, sizeof (ArrayHeader)));
-                destroy_from_range(usr_ptr, array_ptr->count_);
-            }
-
-            memlib::deallocate_log<AllocStrat>(usr_ptr,
-                    Domain::header_size + sizeof(ArrayHeader),
-                    memlib::remove_elem_domain<Domain>);
+            ArrayHeader *array_ptr = reinterpret_cast<ArrayHeader*>(
+                    get_internal_ptr(usr_ptr, sizeof (ArrayHeader)));
+            const std::size_t count = array_ptr->count_;
+            destroy_from_range(usr_ptr, count);
+
+            memlib::deallocate_log<T, Domain, AllocStrat>(usr_ptr, count,
+                    Domain::header_size + sizeof(ArrayHeader));
         }
     }
 }} // namespace nq::memlib
@@ -126,7 +124,7 @@ namespace nq { namespace memlib
 {
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc,
+         class AllocStrat = memlib::domain_alloc_strat<Domain>,
          class... Args>
     T* New(Args... args)
     {
@@ -135,7 +133,7 @@ namespace nq { namespace memlib
 
     template <class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     void Delete(T *ptr)
     {
         delete ptr;
@@ -144,7 +142,7 @@ namespace nq { namespace memlib
 
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc>
+         class AllocStrat = memlib::domain_alloc_strat<Domain>>
     T* New_array(std::size_t count, const std::initializer_list<T>& ilist = {})
     { // allocate a raw memory of size count initialized with ilist
         assert(ilist.size() <= count &&
@@ -158,7 +156,7 @@ namespace nq { namespace memlib
 
     template <class T,
          class Domain = UnknownDomain,
-         class AllocStrat = DefaultAlloc>
+         class AllocStrat = memlib::domain_alloc_strat<Domain>>
     void Delete_array(T *usr_ptr)
     {
         delete[] usr_ptr;
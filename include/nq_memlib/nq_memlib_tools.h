@@ -1,15 +1,77 @@
 #ifndef NQ_MEMLIB_TOOLS_H_
 # define NQ_MEMLIB_TOOLS_H_
 
+# include <cstdint>
+# include <cstring>
 # include <utility>
-# include <functional>
+# include <new>
+# include <type_traits>
+# include <typeinfo>
 
 # include "alloc_strat.h"
+# include "emergency_reserve.h"
+# include "latency_histogram.h"
+# include "type_to_string.h"
 # include "lib_domains.h"
 # include "nq_memlib_allocate.h"
+# include "side_table.h"
 
 namespace nq { namespace memlib
 { 
+    /* Backing flags of the memory strat gave at ptr, logged by the Domain */
+    template<class AllocStrat>
+    size_t backing(AllocStrat& strat, const void *ptr)
+    {
+        return (memlib::huge_backed(strat, ptr) ? backed_huge : 0)
+            | (memlib::prefaulted(strat, ptr) ? backed_prefaulted : 0);
+    }
+
+    /*
+    ** allocate_aligned with strat, or from the emergency reserve of Domain
+    ** when it fails (see DefaultDomainPolicy::emergency_reserve). The
+    ** reserve is refilled once strat gives memory again.
+    ** Throws std::bad_alloc when none can give the memory.
+    */
+    template<class Domain,
+        class AllocStrat>
+    void* allocate_domain(AllocStrat& strat, size_t size, size_t align)
+    {
+        void *ptr = memlib::allocate_aligned(strat, size, align);
+        if (Domain::policy::emergency_reserve != 0)
+        {
+            EmergencyReserve& reserve = memlib::emergency_reserve<Domain>();
+            if (ptr == nullptr)
+                ptr = reserve.allocate(size, align);
+            else if (reserve.needs_refill())
+                reserve.refill();
+        }
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    /* deallocate the memory given by allocate_domain */
+    template<class Domain,
+        class AllocStrat>
+    void deallocate_domain(AllocStrat& strat, void *ptr, size_t size)
+    {
+        if (Domain::policy::emergency_reserve != 0
+                && memlib::emergency_reserve<Domain>().deallocate(ptr))
+            return;
+        memlib::deallocate(strat, ptr, size);
+    }
+
+    /* Backing flags of the memory given by allocate_domain */
+    template<class Domain,
+        class AllocStrat>
+    size_t domain_backing(AllocStrat& strat, const void *ptr)
+    {
+        if (Domain::policy::emergency_reserve != 0
+                && memlib::emergency_reserve<Domain>().owns(ptr))
+            return 0;
+        return memlib::backing(strat, ptr);
+    }
+
     /*
     ** construct() and destroy() construct and destroy an element of type T
     ** at pointer ptr
@@ -88,60 +150,480 @@ namespace nq { namespace memlib
         return reinterpret_cast<T*>(arithmetic_ptr);
     }
 
+    /*
+    ** Size of the headers padded so the memory following them is aligned
+    ** on align (a power of 2) when they start on an align boundary
+    */
+    inline size_t aligned_headers(size_t headers, size_t align)
+    {
+        return (headers + align - 1) & ~(align - 1);
+    }
+
+    /* Alignment of T allocated in Domain: alignof(T) or the Domain's one */
+    template<class T,
+        class Domain>
+    struct domain_alignment : std::integral_constant<size_t,
+        (alignof(T) > static_cast<size_t>(Domain::policy::alignment))
+            ? alignof(T) : static_cast<size_t>(Domain::policy::alignment)>
+    {};
+
+    /*
+    ** Name of T in the type stats: its TypeToString, or when it isn't
+    ** registered (the nodes of the node containers...) its typeid name
+    */
+    template<class T>
+    const char* type_stat_name()
+    {
+        const char* name = TypeToString<T>();
+# if defined(__GXX_RTTI) || defined(_CPPRTTI)
+        if (std::strcmp(name, "UnknownType") == 0)
+            name = typeid(T).name();
+# endif // !__GXX_RTTI
+        return name;
+    }
+
+    /* id of T in the type stats of Domain, 0 when it has none */
+    template<class T,
+        class Domain>
+    size_t type_stat_id()
+    {
+# ifdef WITH_NQ_MEMLOG
+        if (Domain::policy::type_stats != 0)
+        {
+            static const size_t id = memlib::register_type(
+                    memlib::type_stat_name<T>());
+            return id;
+        }
+# endif // !WITH_NQ_MEMLOG
+        return 0;
+    }
+
+    /* time now when Domain has latency_stats, 0 otherwise */
+    template<class Domain>
+    uint64_t latency_clock()
+    {
+# ifdef WITH_NQ_MEMLOG
+        if (Domain::policy::latency_stats != 0)
+            return memlib::latency_now();
+# endif // !WITH_NQ_MEMLOG
+        return 0;
+    }
+
+    /* record a call in the latency stats of Domain, when it has them */
+    template<class Domain>
+    void latency_record(uint64_t strategy_ns, uint64_t domain_ns)
+    {
+# ifdef WITH_NQ_MEMLOG
+        if (Domain::policy::latency_stats != 0)
+            Domain::getInstance().record_latency(strategy_ns, domain_ns);
+# else // WITH_NQ_MEMLOG
+        (void)strategy_ns;
+        (void)domain_ns;
+# endif // !WITH_NQ_MEMLOG
+    }
+
+# ifdef WITH_NQ_MEMLOG
+    /* true when the Header of size bytes allocated in Domain is aside */
+    template<class Domain>
+    bool in_side_table(size_t size)
+    {
+        return Domain::policy::side_table_threshold != 0
+            && size >= static_cast<size_t>(
+                    Domain::policy::side_table_threshold);
+    }
+
+    /*
+    ** allocate_log of the allocations whose Header is in the side table,
+    ** only the extra headers (ArrayHeader...) stay before the user memory
+    */
+    template<class T,
+        class Domain,
+        class AllocStrat>
+    T* allocate_log_side(AllocStrat& strat, size_t count,
+            size_t extra_headers)
+    {
+        const size_t align = memlib::domain_alignment<T, Domain>::value;
+        const size_t prefix = memlib::aligned_headers(extra_headers, align);
+        const size_t size = count * sizeof (T);
+        Domain::getInstance().check_quota(size);
+        const uint64_t start = memlib::latency_clock<Domain>();
+        void *internal_ptr = memlib::allocate_domain<Domain>(strat,
+                size + prefix, align);
+        const uint64_t allocated = memlib::latency_clock<Domain>();
+
+        T *usr_ptr = static_cast<T*>(memlib::get_usr_ptr(internal_ptr, prefix));
+        void *header = memlib::side_table_insert(usr_ptr);
+        if (header == nullptr)
+        {
+            memlib::deallocate_domain<Domain>(strat, internal_ptr,
+                    size + prefix);
+            throw std::bad_alloc();
+        }
+        Domain::getInstance().add(header, size,
+                memlib::domain_backing<Domain>(strat, internal_ptr),
+                memlib::type_stat_id<T, Domain>());
+        memlib::latency_record<Domain>(allocated - start,
+                memlib::latency_clock<Domain>() - allocated);
+        return usr_ptr;
+    }
+
+    template<class T,
+        class Domain,
+        class AllocStrat>
+    void deallocate_log_side(AllocStrat& strat, T *usr_ptr, size_t count,
+            size_t extra_headers)
+    {
+        const size_t prefix = memlib::aligned_headers(extra_headers,
+                memlib::domain_alignment<T, Domain>::value);
+        const uint64_t start = memlib::latency_clock<Domain>();
+        void *header = memlib::side_table_take(usr_ptr);
+        Domain::getInstance().remove(header);
+        memlib::side_table_release(header);
+        const uint64_t removed = memlib::latency_clock<Domain>();
+        memlib::deallocate_domain<Domain>(strat,
+                get_internal_ptr(usr_ptr, prefix), count * sizeof (T) + prefix);
+        memlib::latency_record<Domain>(
+                memlib::latency_clock<Domain>() - removed, removed - start);
+    }
+# endif // !WITH_NQ_MEMLOG
+
     /* allocate_log and deallocate_log are used by every allocating class */
+    /*
+    ** They are a pipeline of compile time policies so every call inlines:
+    **  -AllocStrat: gets and gives back the raw memory
+    **  -headers: the size of the Headers placed before the user memory,
+    **   padded to the alignment of the user memory
+    **  -Domain: Domain::getInstance().add()/remove() log the Header
+    ** Without WITH_NQ_MEMLOG the Headers are 0 bytes and the Domain is never
+    ** called, only the AllocStrat call remains.
+    ** The typed allocate_log/deallocate_log move the Domain Header of the
+    ** big allocations to the side table (see in_side_table).
+    ** The overloads taking an AllocStrat& use that instance (stateful
+    ** strategies kept by nq::allocator), the others a default constructed
+    ** one.
+    */
+    /*
+    ** allocate with AllocStrat size bytes aligned on align, and log them
+    ** in Domain (type is their type_stat_id).
+    */
+    template<class Domain,
+        class AllocStrat>
+    void* allocate_log_aligned(AllocStrat& strat, size_t size, size_t headers,
+            size_t align, size_t type = 0)
+    {
+        if (size == 0)
+            return nullptr;
+# ifdef WITH_NQ_MEMLOG
+        Domain::getInstance().check_quota(size);
+# endif // !WITH_NQ_MEMLOG
+        const size_t prefix = memlib::aligned_headers(headers, align);
+        const uint64_t start = memlib::latency_clock<Domain>();
+        void *internal_ptr = memlib::allocate_domain<Domain>(strat,
+                size + prefix, align);
+        const uint64_t allocated = memlib::latency_clock<Domain>();
+
+# ifdef WITH_NQ_MEMLOG
+        Domain::getInstance().add(internal_ptr, size,
+                memlib::domain_backing<Domain>(strat, internal_ptr), type);
+# else // WITH_NQ_MEMLOG
+        (void)type;
+# endif // !WITH_NQ_MEMLOG
+        memlib::latency_record<Domain>(allocated - start,
+                memlib::latency_clock<Domain>() - allocated);
+
+        return memlib::get_usr_ptr(internal_ptr, prefix);
+    }
+
+    template<class Domain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    void* allocate_log_aligned(size_t size, size_t headers, size_t align)
+    {
+        AllocStrat strat;
+        return memlib::allocate_log_aligned<Domain>(strat, size, headers,
+                align);
+    }
+
     /*
     ** allocate with AllocStrat a new pointer of count elements T, and
     ** log it in Domain.
     */
+    template<class T,
+        class Domain,
+        class AllocStrat>
+    T* allocate_log(AllocStrat& strat, size_t count, size_t headers)
+    {
+        typedef memlib::domain_alignment<T, Domain> alignment;
+        static_assert(alignment::value <= default_alignment
+                || has_aligned_allocate<AllocStrat>::value,
+                "This AllocStrat can't allocate over-aligned memory");
+
+# ifdef WITH_NQ_MEMLOG
+        if (memlib::in_side_table<Domain>(count * sizeof (T)))
+            return memlib::allocate_log_side<T, Domain>(strat, count,
+                    headers - Domain::header_size);
+# endif // !WITH_NQ_MEMLOG
+
+        return static_cast<T*>(memlib::allocate_log_aligned<Domain>(strat,
+                    count * sizeof (T), headers, alignment::value,
+                    memlib::type_stat_id<T, Domain>()));
+    }
+
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
     T* allocate_log(size_t count, size_t headers)
     {
+        AllocStrat strat;
+        return memlib::allocate_log<T, Domain>(strat, count, headers);
+    }
+
+    /*
+    ** This allocate_log overload is used by operator new, T is aligned on
+    ** alignof(T) only: the Domain is not known when deleting.
+    */
+    template<class T,
+        class Domain = UnknownDomain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    T* allocate_log(size_t count, size_t headers,
+            const char* file, size_t line)
+    {
+        static_assert(alignof(T) <= default_alignment
+                || has_aligned_allocate<AllocStrat>::value,
+                "This AllocStrat can't allocate over-aligned memory");
+
         if (count == 0)
             return nullptr;
-        T *internal_ptr = memlib::allocate<T, AllocStrat>(count, headers);
+# ifdef WITH_NQ_MEMLOG
+        Domain::getInstance().check_quota(count * sizeof (T));
+# endif // !WITH_NQ_MEMLOG
+        AllocStrat strat;
+        const size_t prefix = memlib::aligned_headers(headers, alignof(T));
+        void *internal_ptr = memlib::allocate_domain<Domain>(strat,
+                count * sizeof (T) + prefix, alignof(T));
 
-        if (internal_ptr == nullptr)
-            throw std::bad_alloc();
+# ifdef WITH_NQ_MEMLOG
+        Domain::getInstance().add(internal_ptr, count * sizeof (T),
+                file, line, &Domain::getInstance(),
+                memlib::domain_backing<Domain>(strat, internal_ptr));
+# else // WITH_NQ_MEMLOG
+        (void)file;
+        (void)line;
+# endif // !WITH_NQ_MEMLOG
 
-        Domain::getInstance().add(internal_ptr, count * sizeof (T));
+        return static_cast<T*>(memlib::get_usr_ptr(internal_ptr, prefix));
+    }
 
-        return memlib::get_usr_ptr(internal_ptr, headers);
+    /*
+    ** deallocate with AllocStrat the count elements T at usr_ptr allocated
+    ** by allocate_log, and unlog them in Domain.
+    ** The size is given back to the AllocStrat.
+    */
+    template<class T,
+        class Domain,
+        class AllocStrat>
+    void deallocate_log(AllocStrat& strat, T *usr_ptr, size_t count,
+            size_t headers)
+    {
+        if (usr_ptr != nullptr)
+        {
+# ifdef WITH_NQ_MEMLOG
+            if (memlib::in_side_table<Domain>(count * sizeof (T)))
+                return memlib::deallocate_log_side<T, Domain>(strat,
+                        usr_ptr, count, headers - Domain::header_size);
+# endif // !WITH_NQ_MEMLOG
+            const size_t prefix = memlib::aligned_headers(headers,
+                    memlib::domain_alignment<T, Domain>::value);
+            T *internal_ptr = get_internal_ptr(usr_ptr, prefix);
+            const uint64_t start = memlib::latency_clock<Domain>();
+# ifdef WITH_NQ_MEMLOG
+            Domain::getInstance().remove(internal_ptr);
+# endif // !WITH_NQ_MEMLOG
+            const uint64_t removed = memlib::latency_clock<Domain>();
+            memlib::deallocate_domain<Domain>(strat, internal_ptr,
+                    count * sizeof (T) + prefix);
+            memlib::latency_record<Domain>(
+                    memlib::latency_clock<Domain>() - removed, removed - start);
+        }
     }
 
-    /* This allocate_log overload is used by operator new */
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc>
-    T* allocate_log(size_t count, size_t headers,
-            const char* file, size_t line)
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    void deallocate_log(T *usr_ptr, size_t count, size_t headers)
     {
-        if (count == 0)
+        AllocStrat strat;
+        memlib::deallocate_log<T, Domain>(strat, usr_ptr, count, headers);
+    }
+
+    /*
+    ** Resize with AllocStrat::reallocate the old_count elements T at usr_ptr
+    ** allocated by allocate_log to new_count elements, the elements are
+    ** moved as raw memory. nullptr if the AllocStrat can't do it, usr_ptr
+    ** is then unchanged.
+    ** With WITH_NQ_MEMLOG the Header must be in the side table: an inline
+    ** Header linked in its Domain list can't move.
+    */
+    template<class T,
+        class Domain,
+        class AllocStrat>
+    T* reallocate_log(AllocStrat& strat, T *usr_ptr, size_t old_count,
+            size_t new_count, size_t headers)
+    {
+        if (!has_reallocate<AllocStrat>::value || usr_ptr == nullptr)
+            return nullptr;
+        /* the emergency reserve can't resize */
+        if (Domain::policy::emergency_reserve != 0
+                && memlib::emergency_reserve<Domain>().owns(usr_ptr))
             return nullptr;
-        T *internal_ptr = memlib::allocate<T, AllocStrat>(count, headers);
 
+        const size_t align = memlib::domain_alignment<T, Domain>::value;
+        const size_t old_size = old_count * sizeof (T);
+        const size_t new_size = new_count * sizeof (T);
+# ifdef WITH_NQ_MEMLOG
+        if (!memlib::in_side_table<Domain>(old_size)
+                || !memlib::in_side_table<Domain>(new_size))
+            return nullptr;
+        headers -= Domain::header_size;
+        if (new_size > old_size)
+            Domain::getInstance().check_quota(new_size - old_size);
+        void *header = memlib::side_table_find(usr_ptr);
+# endif // !WITH_NQ_MEMLOG
+        const size_t prefix = memlib::aligned_headers(headers, align);
+
+        void *internal_ptr = memlib::reallocate(strat,
+                get_internal_ptr(usr_ptr, prefix),
+                old_size + prefix, new_size + prefix, align);
         if (internal_ptr == nullptr)
-            throw std::bad_alloc();
+            return nullptr;
+        T *new_usr_ptr = static_cast<T*>(
+                memlib::get_usr_ptr(internal_ptr, prefix));
+
+# ifdef WITH_NQ_MEMLOG
+        /* the Header stays in the side table, only its key moves */
+        memlib::side_table_move(header, usr_ptr, new_usr_ptr);
+        Domain::getInstance().resize(header, new_size,
+                memlib::backing(strat, internal_ptr));
+# endif // !WITH_NQ_MEMLOG
+        return new_usr_ptr;
+    }
+
+    template<class T,
+        class Domain = UnknownDomain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    T* reallocate_log(T *usr_ptr, size_t old_count, size_t new_count,
+            size_t headers)
+    {
+        AllocStrat strat;
+        return memlib::reallocate_log<T, Domain>(strat, usr_ptr, old_count,
+                new_count, headers);
+    }
+
+    /*
+    ** true when the memory of T allocated in From can be freed by To: both
+    ** Domains align it and place its Header the same way
+    */
+    template<class T,
+        class From,
+        class To>
+    struct retag_compatible : std::integral_constant<bool,
+        memlib::domain_alignment<T, From>::value
+            == memlib::domain_alignment<T, To>::value
+        && static_cast<size_t>(From::policy::side_table_threshold)
+            == static_cast<size_t>(To::policy::side_table_threshold)>
+    {};
 
-        Domain::getInstance().add(internal_ptr, count,
-                file, line, &Domain::getInstance());
+    /*
+    ** Move the count elements T at usr_ptr allocated by allocate_log in
+    ** From to the Domain To, without reallocating them (see
+    ** BaseDomain::retag): To then deallocates them, with the same
+    ** AllocStrat. false when they come from the emergency reserve of From,
+    ** nothing is moved.
+    */
+    template<class T,
+        class From,
+        class To>
+    bool retag_log(T *usr_ptr, size_t count, size_t headers)
+    {
+        static_assert(retag_compatible<T, From, To>::value,
+                "From and To don't place their Headers the same way");
+        if (usr_ptr == nullptr)
+            return true;
+        if (From::policy::emergency_reserve != 0
+                && memlib::emergency_reserve<From>().owns(usr_ptr))
+            return false;
+# ifdef WITH_NQ_MEMLOG
+        void *header;
+        if (memlib::in_side_table<From>(count * sizeof (T)))
+            header = memlib::side_table_find(usr_ptr);
+        else
+            header = get_internal_ptr(usr_ptr, memlib::aligned_headers(
+                        headers, memlib::domain_alignment<T, From>::value));
+        From::getInstance().retag(header, To::getInstance());
+# else // WITH_NQ_MEMLOG
+        (void)count;
+        (void)headers;
+# endif // !WITH_NQ_MEMLOG
+        return true;
+    }
 
-        return memlib::get_usr_ptr(internal_ptr, headers);
+    /*
+    ** Reserve with strat size bytes up front for the next allocations of
+    ** Domain (see SlabPool::reserve), added to the Domain reserved size.
+    ** Returns the bytes reserved, 0 when the AllocStrat can't reserve.
+    */
+    template<class Domain,
+        class AllocStrat>
+    size_t reserve_log(AllocStrat& strat, size_t size)
+    {
+        size_t reserved = memlib::reserve(strat, size);
+# ifdef WITH_NQ_MEMLOG
+        Domain::getInstance().add_reserved(reserved);
+# endif // !WITH_NQ_MEMLOG
+        return reserved;
+    }
+
+    template<class Domain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    size_t reserve_log(size_t size)
+    {
+        AllocStrat strat;
+        return memlib::reserve_log<Domain>(strat, size);
+    }
+
+    /* trim the AllocStrat of Domain (see memlib::trim(strat, target)) */
+    template<class Domain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    size_t trim(size_t target = 0)
+    {
+        AllocStrat strat;
+        return memlib::trim(strat, target);
     }
 
     /*
-    ** deallocate with AllocStrat pointer ptr, and unlog it in Domain.
+    ** Unsized deallocate_log, for the pointers whose size is not known
+    ** (NQ_NEW'd polymorphic objects, global operator delete).
+    ** align is the one given to the allocation.
+    ** Domain is memlib::HeaderDomain when it is only known from the Header.
     */
-    template<class AllocStrat = DefaultAlloc>
-    void deallocate_log(void *usr_ptr, size_t headers,
-            std::function<void(void*)> remove_header_fun)
+    template<class Domain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    void deallocate_log(void *usr_ptr, size_t headers, size_t align = 1)
     {
         if (usr_ptr != nullptr)
         {
-            void *internal_ptr = get_internal_ptr(usr_ptr, headers);
-            remove_header_fun(internal_ptr);
-            memlib::deallocate<AllocStrat>(internal_ptr);
+            void *internal_ptr = get_internal_ptr(usr_ptr,
+                    memlib::aligned_headers(headers, align));
+            const uint64_t start = memlib::latency_clock<Domain>();
+# ifdef WITH_NQ_MEMLOG
+            Domain::getInstance().remove(internal_ptr);
+# endif // !WITH_NQ_MEMLOG
+            const uint64_t removed = memlib::latency_clock<Domain>();
+            /* NQ_NEW'd memory may come from the reserve of its Domain */
+            if (!EmergencyReserve::any_reserve()
+                    || !EmergencyReserve::deallocate_any(internal_ptr))
+                memlib::deallocate<AllocStrat>(internal_ptr);
+            memlib::latency_record<Domain>(
+                    memlib::latency_clock<Domain>() - removed, removed - start);
         }
     }
 }} // namespace nq::memlib
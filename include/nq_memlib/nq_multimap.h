@@ -12,7 +12,7 @@ namespace nq
     template<class Key,
         class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class Compare = std::less<Key>>
     class multimap
         : public std::multimap<const Key, T, Compare,
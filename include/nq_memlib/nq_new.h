@@ -18,17 +18,27 @@ class NewedType
     char size;
 };
 
+/*
+** NQ_NEW always allocates with DefaultAlloc (and not with the Domain policy
+** AllocStrat), NQ_DELETE can only recover the Domain at runtime.
+*/
+/* It throws std::bad_alloc, or domain_bad_alloc at the hard quota. */
 template<class Domain>
 void* operator new(size_t count,
-        const Domain&, size_t line, const char* file) noexcept
+        const Domain&, size_t line, const char* file)
 {
-    return nq::memlib::allocate_log<NewedType, Domain>(count,
+    return nq::memlib::allocate_log<NewedType, Domain, DefaultAlloc>(count,
             Domain::sub_header_size, file, line);
 }
 
-namespace nq { namespace memlib {
-    void remove_header_operator_delete(void *ptr);
-}} // namespace nq::memlib
+/* frees the memory of an NQ_NEW whose constructor threw */
+template<class Domain>
+void operator delete(void *ptr,
+        const Domain&, size_t, const char*) noexcept
+{
+    nq::memlib::deallocate_log<nq::memlib::HeaderDomain, DefaultAlloc>(
+            ptr, BaseDomain::sub_header_size);
+}
 
 /** This specific NEW is only reserved for internal implementations **/
 # define INTERNAL_NQ_NEW(Domain) new (Domain, 0, nullptr)
@@ -57,29 +67,33 @@ namespace nq { namespace memlib {
 
 # define NQ_DELETE_ARAY(ptr) nqDeleteArray(ptr)
 
-# ifndef WITH_NQ_MEMOFF
+/* log in Domain what was NQ_NEW'd in another one (see BaseDomain::retag) */
+# define NQ_RETAG(Domain, ptr) nqRetag<Domain>(ptr)
 
-namespace nq { namespace memlib {
-    void remove_header_operator_delete(void *ptr); }}
+# define NQ_RETAG_ARRAY(Domain, ptr) nqRetagArray<Domain>(ptr)
+
+# ifndef WITH_NQ_MEMOFF
 
 template<class T>
 void nqDelete(T *ptr)
 {
+    static_assert(alignof(T) <= nq::memlib::default_alignment,
+            "NQ_NEW can't allocate over-aligned types, use nq::memlib::New");
     if (ptr != nullptr)
     {
         nq::memlib::destroy(ptr);
-        nq::memlib::deallocate_log(ptr, BaseDomain::sub_header_size,
-                nq::memlib::remove_header_operator_delete);
+        nq::memlib::deallocate_log<nq::memlib::HeaderDomain, DefaultAlloc>(
+                ptr, BaseDomain::sub_header_size);
     }
 }
 
 struct ArrayHeader
 {
-    ArrayHeader(uint32_t size)
+    ArrayHeader(size_t size)
         : count_(size)
     {}
 
-    uint32_t count_;
+    size_t count_;
 };
 
 template<class T,
@@ -87,7 +101,7 @@ template<class T,
 T* nqNewArray(const char* file, int line, size_t count)
 {
     /* Allocate the user + header + arraHeader size and log with file line */
-    T *usr_ptr = nq::memlib::allocate_log<T, Domain>(count * sizeof (T),
+    T *usr_ptr = nq::memlib::allocate_log<T, Domain, DefaultAlloc>(count,
             Domain::sub_header_size + sizeof (ArrayHeader), file, line);
 
     /*
@@ -117,9 +131,36 @@ void nqDeleteArray(T *usr_ptr)
             nq::memlib::destroy_from_range(usr_ptr, array_ptr->count_);
         }
 
-        nq::memlib::deallocate_log(usr_ptr,
-                BaseDomain::sub_header_size + sizeof(ArrayHeader),
-                nq::memlib::remove_header_operator_delete);
+        nq::memlib::deallocate_log<nq::memlib::HeaderDomain, DefaultAlloc>(
+                usr_ptr, BaseDomain::sub_header_size + sizeof(ArrayHeader),
+                alignof(T));
+    }
+}
+
+template<class Domain,
+    class T>
+void nqRetag(T *ptr)
+{
+    if (ptr != nullptr)
+    {
+        void *internal_ptr = nq::memlib::get_internal_ptr<void>(ptr,
+                BaseDomain::sub_header_size);
+        nq::memlib::retag_header_operator_delete(internal_ptr,
+                Domain::getInstance());
+    }
+}
+
+template<class Domain,
+    class T>
+void nqRetagArray(T *usr_ptr)
+{
+    if (usr_ptr != nullptr)
+    {
+        void *internal_ptr = nq::memlib::get_internal_ptr<void>(usr_ptr,
+                nq::memlib::aligned_headers(BaseDomain::sub_header_size
+                    + sizeof (ArrayHeader), alignof(T)));
+        nq::memlib::retag_header_operator_delete(internal_ptr,
+                Domain::getInstance());
     }
 }
 
@@ -143,6 +184,16 @@ void nqDeleteArray(T *ptr)
 {
     delete[] ptr;
 }
+
+template<class Domain,
+    class T>
+void nqRetag(T *)
+{}
+
+template<class Domain,
+    class T>
+void nqRetagArray(T *)
+{}
 # endif // !WITH_NQ_MEMOFF
 
 #endif // !NQ_NEW_H_
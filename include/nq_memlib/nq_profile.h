@@ -0,0 +1,86 @@
+#ifndef NQ_PROFILE_H_
+# define NQ_PROFILE_H_
+
+# include <cstddef>
+# include <string>
+# include <type_traits>
+# include <vector>
+
+# include "nq_memlib_tools.h"
+# include "pool_alloc.h"
+
+/*
+** Profile of the peak live allocations of every Domain per size class of
+** the pools, saved by a run so the next one reserves its pools up front
+** instead of growing them chunk by chunk (warmup).
+** The counts are only kept by the Domains whose policy has profile_stats,
+** with WITH_NQ_MEMLOG (at the counters level and above): without it the
+** profile is empty.
+*/
+
+namespace nq { namespace memlib {
+    struct ProfileEntry
+    {
+        std::string domain;
+        size_t class_size; // 0 for the allocations bigger than the classes
+        size_t peak; // peak live count, in bytes for class_size 0
+    };
+
+    typedef std::vector<ProfileEntry> Profile;
+
+    /* the peaks of the running process */
+    Profile current_profile();
+
+    /*
+    ** One "domain class_size peak" line per entry, false if the file can't
+    ** be written (or read)
+    */
+    bool save_profile(const std::string& filepath);
+    bool load_profile(const std::string& filepath, Profile& profile);
+
+    /* save the profile to filepath when the process exits */
+    void save_profile_at_exit(const std::string& filepath);
+
+    /*
+    ** bytes the pools need to hold the peaks of domain_name, with headers
+    ** bytes of Headers before each allocation: every size class carves its
+    ** own slabs, so each one is rounded up to whole chunks of chunk_size
+    */
+    size_t profile_size(const Profile& profile, const char* domain_name,
+            size_t headers = 0, size_t chunk_size = PageSource::chunk_size);
+
+    /* the chunk_size of AllocStrat (PoolAlloc...), PageSource's if none */
+    template<class AllocStrat,
+        class = void>
+    struct strat_chunk_size
+        : std::integral_constant<size_t, PageSource::chunk_size>
+    {};
+
+    template<class AllocStrat>
+    struct strat_chunk_size<AllocStrat,
+        decltype(void(AllocStrat::chunk_size))>
+        : std::integral_constant<size_t, AllocStrat::chunk_size>
+    {};
+
+    /*
+    ** Reserve in the AllocStrat of Domain what its peaks of profile need
+    ** (see reserve_log), returns the bytes reserved.
+    ** Domain must be named, so it does nothing without WITH_NQ_MEMLOG.
+    */
+    template<class Domain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    size_t warmup(const Profile& profile)
+    {
+# ifdef WITH_NQ_MEMLOG
+        size_t size = memlib::profile_size(profile,
+                Domain::getInstance().name(), Domain::header_size,
+                strat_chunk_size<AllocStrat>::value);
+        return size == 0 ? 0 : memlib::reserve_log<Domain, AllocStrat>(size);
+# else // WITH_NQ_MEMLOG
+        (void)profile;
+        return 0;
+# endif // !WITH_NQ_MEMLOG
+    }
+}} // namespace nq::memlib
+
+#endif // !NQ_PROFILE_H_
@@ -0,0 +1,261 @@
+#ifndef NQ_RAW_VECTOR_H_
+# define NQ_RAW_VECTOR_H_
+
+# include <cstring>
+# include <initializer_list>
+# include <type_traits>
+# include <utility>
+
+# include "nq_memlib_tools.h"
+# include "alloc_strat.h"
+# include "lib_domains.h"
+
+namespace nq
+{
+    /*
+    ** raw_vector is a vector of trivially copyable T owning its storage,
+    ** allocated with memlib::allocate_log in Domain.
+    ** Its growth resizes the storage with memlib::reallocate_log when the
+    ** AllocStrat has reallocate (MmapAlloc remaps the pages of the big
+    ** arrays), else allocates, copies the bytes and deallocates.
+    ** The elements are never constructed one by one: resize(count) leaves
+    ** the new ones uninitialized.
+    */
+    template<typename T,
+        class Domain = UnknownDomain,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>>
+    class raw_vector
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                "raw_vector moves its elements as raw memory");
+
+        template<typename U,
+            class OtherDomain,
+            class OtherStrat>
+        friend class raw_vector;
+
+    public:
+        typedef T value_type;
+        typedef std::size_t size_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+
+        /*** Constructors ***/
+        raw_vector()
+            : data_(nullptr), size_(0), capacity_(0)
+        { // construct empty raw_vector
+        }
+
+        explicit raw_vector(const AllocStrat& strat)
+            : strat_(strat), data_(nullptr), size_(0), capacity_(0)
+        { // construct empty raw_vector using the AllocStrat instance strat
+        }
+
+        explicit raw_vector(size_type count)
+            : data_(nullptr), size_(0), capacity_(0)
+        { // construct raw_vector of count uninitialized elements
+            resize(count);
+        }
+
+        raw_vector(size_type count, const value_type& value)
+            : data_(nullptr), size_(0), capacity_(0)
+        { // construct raw_vector of size count copies of value
+            resize(count, value);
+        }
+
+        raw_vector(std::initializer_list<value_type> Ilist)
+            : data_(nullptr), size_(0), capacity_(0)
+        { // construct raw_vector from the initializer_list
+            assign(Ilist.begin(), Ilist.size());
+        }
+
+        raw_vector(const raw_vector& other)
+            : strat_(other.strat_), data_(nullptr), size_(0), capacity_(0)
+        { // construct by copying other
+            assign(other.data_, other.size_);
+        }
+
+        raw_vector(raw_vector&& other) noexcept
+            : strat_(other.strat_), data_(other.data_), size_(other.size_),
+            capacity_(other.capacity_)
+        { // construct by taking the storage of other
+            other.data_ = nullptr;
+            other.size_ = 0;
+            other.capacity_ = 0;
+        }
+
+        /*
+        ** Construct by taking the storage of other, allocated in another
+        ** Domain: memlib::retag_log moves its Header to Domain, nothing is
+        ** copied. Only the storage from the emergency reserve of
+        ** OtherDomain is copied. other is left empty.
+        */
+        template<class OtherDomain>
+        explicit raw_vector(raw_vector<T, OtherDomain, AllocStrat>&& other)
+            : strat_(other.strat_), data_(nullptr), size_(0), capacity_(0)
+        {
+            if (memlib::retag_log<T, OtherDomain, Domain>(other.data_,
+                        other.capacity_, OtherDomain::header_size))
+            {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                std::swap(capacity_, other.capacity_);
+            }
+            else
+            {
+                assign(other.data_, other.size_);
+                other.clear();
+                other.shrink_to_fit();
+            }
+        }
+
+        ~raw_vector()
+        {
+            memlib::deallocate_log<T, Domain>(strat_, data_, capacity_,
+                    Domain::header_size);
+        }
+
+        /* Assignement operators */
+
+        raw_vector& operator=(const raw_vector& other)
+        { // assign raw_vector from right
+            if (this != &other)
+                assign(other.data_, other.size_);
+            return *this;
+        }
+
+        raw_vector& operator=(raw_vector&& other) noexcept
+        { // assign raw_vector by taking the storage of other
+            raw_vector moved(std::move(other));
+            swap(moved);
+            return *this;
+        }
+
+        template<class OtherDomain>
+        raw_vector& operator=(raw_vector<T, OtherDomain, AllocStrat>&& other)
+        { // assign raw_vector by taking the storage of other
+            raw_vector moved(std::move(other));
+            swap(moved);
+            return *this;
+        }
+
+        void swap(raw_vector& other) noexcept
+        {
+            std::swap(strat_, other.strat_);
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(capacity_, other.capacity_);
+        }
+
+        /*** Element access ***/
+        T& operator[](size_type pos) { return data_[pos]; }
+        const T& operator[](size_type pos) const { return data_[pos]; }
+        T& back() { return data_[size_ - 1]; }
+        const T& back() const { return data_[size_ - 1]; }
+        T* data() noexcept { return data_; }
+        const T* data() const noexcept { return data_; }
+
+        iterator begin() noexcept { return data_; }
+        const_iterator begin() const noexcept { return data_; }
+        iterator end() noexcept { return data_ + size_; }
+        const_iterator end() const noexcept { return data_ + size_; }
+
+        /*** Capacity ***/
+        bool empty() const noexcept { return size_ == 0; }
+        size_type size() const noexcept { return size_; }
+        size_type capacity() const noexcept { return capacity_; }
+
+        const AllocStrat& strategy() const
+        { return strat_; }
+
+        void reserve(size_type count)
+        {
+            if (count > capacity_)
+                reallocate(count);
+        }
+
+        void shrink_to_fit()
+        {
+            if (size_ < capacity_)
+                reallocate(size_);
+        }
+
+        /*** Modifiers ***/
+        void clear() noexcept { size_ = 0; }
+
+        void push_back(const value_type& value)
+        {
+            if (size_ == capacity_)
+            {
+                /* value may be in the storage that moves */
+                const value_type copy = value;
+                grow(size_ + 1);
+                data_[size_++] = copy;
+            }
+            else
+                data_[size_++] = value;
+        }
+
+        void pop_back() { --size_; }
+
+        void resize(size_type count)
+        {
+            grow(count);
+            size_ = count;
+        }
+
+        void resize(size_type count, const value_type& value)
+        {
+            const value_type copy = value;
+            grow(count);
+            for (size_type pos = size_; pos < count; ++pos)
+                data_[pos] = copy;
+            size_ = count;
+        }
+
+    private:
+        /* make room for count elements, doubling the capacity */
+        void grow(size_type count)
+        {
+            if (count > capacity_)
+                reallocate(count < 2 * capacity_ ? 2 * capacity_ : count);
+        }
+
+        /* replace the elements by the count ones at src */
+        void assign(const T *src, size_type count)
+        {
+            clear();
+            reserve(count);
+            if (count != 0)
+                std::memcpy(data_, src, count * sizeof (T));
+            size_ = count;
+        }
+
+        /* resize the storage to count elements, keeping the first size_ */
+        void reallocate(size_type count)
+        {
+            T *storage = nullptr;
+            if (count != 0)
+                storage = memlib::reallocate_log<T, Domain>(strat_, data_,
+                        capacity_, count, Domain::header_size);
+            if (storage == nullptr)
+            {
+                storage = memlib::allocate_log<T, Domain>(strat_, count,
+                        Domain::header_size);
+                if (size_ != 0)
+                    std::memcpy(storage, data_, size_ * sizeof (T));
+                memlib::deallocate_log<T, Domain>(strat_, data_, capacity_,
+                        Domain::header_size);
+            }
+            data_ = storage;
+            capacity_ = count;
+        }
+
+        AllocStrat strat_;
+        T *data_;
+        size_type size_;
+        size_type capacity_;
+    };
+}
+
+#endif // !NQ_RAW_VECTOR_H_
@@ -0,0 +1,48 @@
+#ifndef NQ_REPORT_H_
+# define NQ_REPORT_H_
+
+# include <iostream>
+# include <string>
+
+# include "env_maccro.h"
+
+# ifndef NQ_WIN_
+#  include <csignal>
+# endif // !NQ_WIN_
+
+/*
+** Heap reports of a live process.
+** Unlike nq::log::print(), a report is built from a snapshot of the Domains
+** (see BaseDomain::snapshot) so the allocating threads are only blocked the
+** time to copy a chunk of call sites, never during the formatting or the
+** file output.
+*/
+
+namespace nq { namespace log {
+    /* write a per Domain and per call site report in os */
+    void report(std::ostream& os, const char* message = "heap report");
+
+    /*
+    ** Start the report thread, every call to request_report() (or every
+    ** signum received under unix) appends a report to the file filepath.
+    ** Return false if the thread could not be started (or already runs).
+    */
+# ifndef NQ_WIN_
+    bool start_report_thread(const std::string& filepath,
+            int signum = SIGUSR1);
+# else // !NQ_WIN_
+    bool start_report_thread(const std::string& filepath);
+# endif // NQ_WIN_
+
+    /* stop the report thread and restore the previous signal handler */
+    void stop_report_thread();
+
+    /*
+    ** Ask the report thread for a report.
+    ** Only does a write() on a pipe, so it is async-signal-safe and never
+    ** blocks the caller.
+    */
+    void request_report();
+}} // namespace nq::log
+
+#endif // !NQ_REPORT_H_
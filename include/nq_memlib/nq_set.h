@@ -11,7 +11,7 @@ namespace nq
 {
     template<class Key,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class Compare = std::less<Key>>
     class set
         : public std::set<Key, Compare, nq::allocator<Key, Domain, AllocStrat>>
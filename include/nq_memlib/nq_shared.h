@@ -24,13 +24,13 @@ namespace nq
 
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class... Args>
     shared_ptr<T> make_shared(Args&&... args);
 
     template<class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class... Args>
     shared_ptr<T> new_shared(Args&&... args);
 
@@ -196,7 +196,7 @@ namespace nq
         /** library specific functions **/
         
         template<class Domain = UnknownDomain,
-            class AllocStrat = DefaultAlloc,
+            class AllocStrat = memlib::domain_alloc_strat<Domain>,
             class... Args>
         void new_reset(Args... args)
         {
@@ -205,7 +205,7 @@ namespace nq
         }
 
         template<class Domain = UnknownDomain,
-            class AllocStrat = DefaultAlloc,
+            class AllocStrat = memlib::domain_alloc_strat<Domain>,
             class... Args>
         void make_reset(Args... args)
         {
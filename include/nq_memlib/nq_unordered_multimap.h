@@ -12,7 +12,7 @@ namespace nq
     template<class Key,
         class T,
         class Domain = UnknownDomain,
-        class AllocStrat = DefaultAlloc,
+        class AllocStrat = memlib::domain_alloc_strat<Domain>,
         class Hash = std::hash<Key>,
         class KeyEqual = std::equal_to<Key>>
     class unordered_multimap
@@ -0,0 +1,101 @@
+#ifndef NQ_NUMA_ALLOC_H_
+# define NQ_NUMA_ALLOC_H_
+
+# include <cstddef>
+
+# include "pool_alloc.h"
+
+namespace nq { namespace memlib
+{
+    /* number of NUMA nodes of the machine, 1 without NUMA */
+    int numa_node_count();
+
+    /* NUMA node of the cpu running the calling thread */
+    int current_numa_node();
+
+    /*
+    ** SlabPool (arena) of a NUMA node, its chunks are bound on the node.
+    ** The nodes beyond max_numa_nodes share the arenas modulo it.
+    */
+    enum { max_numa_nodes = 16 };
+    SlabPool& numa_pool(int node);
+
+    /* SlabPool::set_options of every arena */
+    void set_numa_pool_options(unsigned options);
+
+    /* SlabPool::trim of every arena, target is shared between them */
+    std::size_t trim_numa_pools(std::size_t target);
+}} // namespace nq::memlib
+
+/*
+** NumaAlloc allocates from the arena of a NUMA node: the node of the
+** calling thread by default, or the node it is built with. It is stateful,
+** give an instance to the allocator of a container to pin its memory:
+**  nq::vector<int, Domain, NumaAlloc> vec(
+**      nq::allocator<int, Domain, NumaAlloc>(NumaAlloc(1)));
+** Every instance can deallocate the memory of any node. On a single node
+** machine all of them use the same arena.
+*/
+struct NumaAlloc
+{
+    enum { current_node = -1 };
+
+    explicit NumaAlloc(int node = current_node)
+        : node_(node)
+    {}
+
+    /* node the next allocations are taken on */
+    int node() const
+    {
+        return node_ == current_node ? nq::memlib::current_numa_node() : node_;
+    }
+
+    void* allocate(std::size_t size)
+    {
+        return nq::memlib::numa_pool(node()).allocate(size,
+                alignof(std::max_align_t));
+    }
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        return nq::memlib::numa_pool(node()).allocate(size, align);
+    }
+
+    /* the chunk of ptr knows its arena */
+    void deallocate(void *ptr)
+    {
+        nq::memlib::numa_pool(0).deallocate(ptr);
+    }
+
+    void deallocate(void *ptr, std::size_t)
+    {
+        nq::memlib::numa_pool(0).deallocate(ptr);
+    }
+
+    bool huge_backed(const void *ptr)
+    {
+        return nq::memlib::numa_pool(0).huge_backed(ptr);
+    }
+
+    bool prefaulted(const void *ptr)
+    {
+        return nq::memlib::numa_pool(0).prefaulted(ptr);
+    }
+
+    /* reserve in the arena of node() */
+    std::size_t reserve(std::size_t size)
+    {
+        return nq::memlib::numa_pool(node()).reserve(size);
+    }
+
+    /* trims the arenas of every node */
+    std::size_t trim(std::size_t target)
+    {
+        return nq::memlib::trim_numa_pools(target);
+    }
+
+private:
+    int node_;
+};
+
+#endif // !NQ_NUMA_ALLOC_H_
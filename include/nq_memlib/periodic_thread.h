@@ -0,0 +1,62 @@
+#ifndef NQ_PERIODIC_THREAD_H_
+# define NQ_PERIODIC_THREAD_H_
+
+# include <atomic>
+# include <chrono>
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+
+namespace nq { namespace memlib
+{
+    /*
+    ** Thread calling a task every period until stopped, for the decay and
+    ** the pressure threads. It is stopped by its destructor: a joinable
+    ** std::thread destroyed at exit would call terminate().
+    */
+    class PeriodicThread
+    {
+    public:
+        typedef void (*Task)();
+
+        PeriodicThread()
+            : stop_(false),
+            woken_(false)
+        {}
+
+        ~PeriodicThread()
+        {
+            stop();
+        }
+
+        /* false if the thread could not be started (or already runs) */
+        bool start(std::chrono::milliseconds period, Task task);
+        void stop();
+
+        /*
+        ** Call the task now instead of at the end of the period. It never
+        ** blocks nor throws: a wake coming while the task runs is only
+        ** seen at the next period.
+        */
+        inline void wake() noexcept
+        {
+            woken_.store(true, std::memory_order_release);
+            wake_.notify_one();
+        }
+
+    private:
+        PeriodicThread(const PeriodicThread&);
+        PeriodicThread& operator=(const PeriodicThread&);
+
+        void loop(std::chrono::milliseconds period, Task task);
+
+        std::thread thread_;
+        std::mutex state_; // held by start/stop
+        std::mutex mutex_; // protects stop_
+        std::condition_variable wake_;
+        bool stop_;
+        std::atomic<bool> woken_;
+    };
+}} // namespace nq::memlib
+
+#endif // !NQ_PERIODIC_THREAD_H_
@@ -0,0 +1,241 @@
+#ifndef NQ_POOL_ALLOC_H_
+# define NQ_POOL_ALLOC_H_
+
+# include <atomic>
+# include <chrono>
+# include <cstddef>
+# include <mutex>
+# include <new>
+# include <type_traits>
+
+# include "chunk_source.h"
+
+namespace nq { namespace memlib
+{
+    /*
+    ** SlabPool carves the chunks of a ChunkSource in slabs of size classes
+    ** (16 bytes to 32 KiB, 4 classes per power of 2), each class has its
+    ** own lock and free list. The bigger allocations get their own run of
+    ** chunks.
+    ** Every chunk starts with a ChunkHeader: an allocation finds its size
+    ** class, its pool (and whether it is on huge pages) from its address
+    ** alone, so any SlabPool of the same chunk_size deallocates it.
+    ** The chunks of a pool are taken on its NUMA node (any node when -1).
+    ** With the prefault/lock_pages options the chunks are faulted in (and
+    ** mlocked) when taken from the ChunkSource, and reserve() takes them
+    ** up front: the allocations made later never page fault.
+    ** The chunks without any live block go back to the ChunkSource with
+    ** trim(), every pool is known by trim_all() and the decay thread.
+    */
+    class SlabPool
+    {
+    public:
+        typedef void* (*ChunkAlloc)(std::size_t size, int node,
+                ChunkPages& pages);
+        typedef void (*ChunkDealloc)(void *chunk, std::size_t size);
+
+        SlabPool(ChunkAlloc chunk_alloc, ChunkDealloc chunk_dealloc,
+                std::size_t chunk_size, int node = -1);
+        /* the chunks still held are not given back */
+        ~SlabPool();
+
+        /* nullptr when the ChunkSource is out of memory */
+        void* allocate(std::size_t size, std::size_t align);
+        void deallocate(void *ptr);
+
+        /* true if the chunk of ptr is backed by explicit huge pages */
+        bool huge_backed(const void *ptr) const;
+        /* true if the chunk of ptr was faulted in when taken */
+        bool prefaulted(const void *ptr) const;
+
+        enum Options { prefault = 1,
+            lock_pages = 2 }; // mlock, falls back to prefault when refused
+
+        /* Options of the chunks taken from now on */
+        inline void set_options(unsigned options)
+        { options_.store(options, std::memory_order_relaxed); }
+        inline unsigned get_options() const
+        { return options_.load(std::memory_order_relaxed); }
+
+        /*
+        ** Take chunks for size bytes from the ChunkSource now, the next
+        ** slabs are carved in them. Returns the bytes reserved (the chunks
+        ** are counted in the chunks size).
+        */
+        std::size_t reserve(std::size_t size);
+
+        /*
+        ** Give the chunks without any live block back to the ChunkSource
+        ** (munmap) until the pool holds at most target bytes, the reserved
+        ** chunks last unless keep_reserved. With decay a chunk only goes if
+        ** it already had no live block at the previous decay trim, and the
+        ** reserved chunks stay. Returns the bytes given back.
+        */
+        std::size_t trim(std::size_t target = 0, bool decay = false,
+                bool keep_reserved = false);
+
+        /* trim every SlabPool down to 0, returns the bytes given back */
+        static std::size_t trim_all(bool decay = false);
+        /* trim the SlabPools until they hold at most target bytes together */
+        static std::size_t trim_total(std::size_t target, bool keep_reserved);
+
+        /* bytes taken from the ChunkSources by every SlabPool */
+        static std::size_t get_total_chunks_size();
+
+        /*
+        ** bytes taken from the ChunkSource, the huge pages ones and the ones
+        ** advised to use transparent huge pages (see ChunkPages)
+        */
+        inline std::size_t get_chunks_size() const
+        { return chunks_size_.load(std::memory_order_relaxed); }
+        inline std::size_t get_huge_chunks_size() const
+        { return huge_chunks_size_.load(std::memory_order_relaxed); }
+        inline std::size_t get_advised_chunks_size() const
+        { return advised_chunks_size_.load(std::memory_order_relaxed); }
+
+        inline int get_node() const
+        { return node_; }
+
+        /* bytes of the reserved chunks not carved yet */
+        inline std::size_t get_reserved_size() const
+        { return reserved_size_.load(std::memory_order_relaxed); }
+        /* bytes of the chunks faulted in (or locked) when taken */
+        inline std::size_t get_faulted_size() const
+        { return faulted_size_.load(std::memory_order_relaxed); }
+        inline std::size_t get_locked_size() const
+        { return locked_size_.load(std::memory_order_relaxed); }
+        /* bytes given back by trim() since the pool creation */
+        inline std::size_t get_trimmed_size() const
+        { return trimmed_size_.load(std::memory_order_relaxed); }
+
+    public:
+        enum { nb_classes = 40,
+            max_class_size = 32 * 1024 };
+
+        /* index of the smallest class holding size bytes aligned on align,
+         * nb_classes if none */
+        static std::size_t class_of(std::size_t size, std::size_t align);
+        static std::size_t class_size(std::size_t index);
+        static std::size_t class_alignment(std::size_t index);
+        /* blocks of the class index carved in a slab of chunk_size bytes */
+        static std::size_t slab_blocks(std::size_t index,
+                std::size_t chunk_size);
+
+    private:
+        struct ChunkHeader;
+
+        struct SizeClass
+        {
+            std::mutex mutex_;
+            /* the slabs with freed blocks, chained by their next_ */
+            ChunkHeader *partial_ = nullptr;
+            char *bump_ = nullptr; // never used blocks of the last slab
+            char *end_ = nullptr;
+        };
+
+        ChunkHeader* take_chunk(std::size_t size);
+        ChunkHeader* new_chunk(std::size_t size, std::size_t index,
+                std::size_t offset);
+        void free_chunk(ChunkHeader *header);
+        ChunkHeader* collect_free_chunks(SizeClass& size_class,
+                std::size_t target, bool decay);
+        ChunkHeader* chunk_of(const void *ptr) const;
+
+    private:
+        ChunkAlloc chunk_alloc_;
+        ChunkDealloc chunk_dealloc_;
+        std::size_t chunk_size_;
+        int node_;
+        SizeClass classes_[nb_classes];
+        std::atomic<std::size_t> chunks_size_;
+        std::atomic<std::size_t> huge_chunks_size_;
+        std::atomic<std::size_t> advised_chunks_size_;
+        std::atomic<unsigned> options_;
+        std::mutex spare_mutex_;
+        ChunkHeader *spare_ = nullptr; // reserved chunks, by their next_
+        std::atomic<std::size_t> reserved_size_;
+        std::atomic<std::size_t> faulted_size_;
+        std::atomic<std::size_t> locked_size_;
+        std::atomic<std::size_t> trimmed_size_;
+        SlabPool *prev_pool_; // every SlabPool, for trim_all
+        SlabPool *next_pool_;
+    };
+
+    /*
+    ** Start the decay thread: every period it calls SlabPool::trim_all(true)
+    ** so the chunks idle for a whole period go back to the OS.
+    ** Return false if the thread could not be started (or already runs).
+    */
+    bool start_decay_thread(std::chrono::milliseconds period);
+    void stop_decay_thread();
+
+    /* bytes given back by the decay thread since it started */
+    std::size_t get_decayed_size();
+}} // namespace nq::memlib
+
+/*
+** PoolAlloc is the AllocStrat of the SlabPool of its ChunkSource (one pool
+** per ChunkSource shared by every Domain), it doesn't need the size to
+** deallocate so it can be used by NQ_NEW too.
+*/
+template<class Source = nq::memlib::PageSource>
+struct PoolAlloc
+{
+    enum { chunk_size = Source::chunk_size };
+
+    void* allocate(std::size_t size)
+    {
+        return pool().allocate(size, alignof(std::max_align_t));
+    }
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        return pool().allocate(size, align);
+    }
+
+    void deallocate(void *ptr)
+    {
+        pool().deallocate(ptr);
+    }
+
+    void deallocate(void *ptr, std::size_t)
+    {
+        pool().deallocate(ptr);
+    }
+
+    bool huge_backed(const void *ptr)
+    {
+        return pool().huge_backed(ptr);
+    }
+
+    bool prefaulted(const void *ptr)
+    {
+        return pool().prefaulted(ptr);
+    }
+
+    std::size_t reserve(std::size_t size)
+    {
+        return pool().reserve(size);
+    }
+
+    std::size_t trim(std::size_t target)
+    {
+        return pool().trim(target);
+    }
+
+    static nq::memlib::SlabPool& pool()
+    {
+        /* never destroyed: static objects may still free in it at exit */
+        static typename std::aligned_storage<sizeof (nq::memlib::SlabPool),
+               alignof(nq::memlib::SlabPool)>::type storage;
+        static nq::memlib::SlabPool *instance = new (&storage)
+            nq::memlib::SlabPool(&Source::allocate_chunk,
+                    &Source::deallocate_chunk, Source::chunk_size);
+        return *instance;
+    }
+};
+
+/* PoolAlloc on 2 MiB pages, for the big and hot containers */
+typedef PoolAlloc<nq::memlib::HugePageSource> HugePageAlloc;
+
+#endif // !NQ_POOL_ALLOC_H_
@@ -0,0 +1,45 @@
+#ifndef NQ_SIDE_TABLE_H_
+# define NQ_SIDE_TABLE_H_
+
+# include <cstddef>
+
+namespace nq { namespace memlib
+{
+    /*
+    ** The side table keeps the Headers of the big allocations (see the
+    ** side_table_threshold of the Domain policies) out of their memory, so a
+    ** page sized buffer stays page sized and page aligned.
+    ** It is a hash table keyed by the user pointer, split in stripes locked
+    ** separately. The Headers it holds are added to their Domain as any
+    ** other one: they are listed, counted and printed the same way.
+    */
+
+    /*
+    ** Insert usr_ptr and return the memory where to construct its Header
+    ** (a SubHeader fits), nullptr if out of memory
+    */
+    void* side_table_insert(const void *usr_ptr);
+
+    /*
+    ** Remove usr_ptr and return its Header, which stays valid until given
+    ** to side_table_release (once removed from its Domain).
+    ** Aborts if usr_ptr isn't in the side table.
+    */
+    void* side_table_take(const void *usr_ptr);
+    void side_table_release(void *header);
+
+    /* Header of usr_ptr, nullptr if it isn't in the side table */
+    void* side_table_find(const void *usr_ptr);
+
+    /*
+    ** Key again under new_usr_ptr the Header of the allocation moved from
+    ** old_usr_ptr (the Header itself doesn't move)
+    */
+    void side_table_move(void *header, const void *old_usr_ptr,
+            const void *new_usr_ptr);
+
+    /* number of allocations whose Header is in the side table */
+    std::size_t side_table_size();
+}} // namespace nq::memlib
+
+#endif // !NQ_SIDE_TABLE_H_
@@ -1,11 +1,14 @@
 #ifndef TYPE_TO_STRING_H_
 # define TYPE_TO_STRING_H_
 
-# include "lib_domains.h"
-# include "alloc_strat.h"
+# include <cstddef>
 
 namespace nq
 {
+    /*
+    ** Name of T, "UnknownType" unless registered with REGISTER_TYPE_NAME.
+    ** The Domains with type_stats count their allocations by this name.
+    */
     template<typename T>
     const char* TypeToString()
     {
@@ -13,16 +16,15 @@ namespace nq
     }
 
 #define COMMA ,
+/* inline: the registrations live in headers included everywhere */
 #define REGISTER_TYPE_NAME(NAME) template <>\
-    const char* TypeToString<NAME>() { return #NAME; };
+    inline const char* TypeToString<NAME>() { return #NAME; }
 
     /***********************/
     /* User specific types */
     /***********************/
 
-    REGISTER_TYPE_NAME(nq::allocator<int>);
-    //REGISTER_TYPE_NAME(nq::allocator<int COMMA DomainEarth COMMA DefaultAlloc>);
-    //REGISTER_TYPE_NAME(DomainEarth);
+    //REGISTER_TYPE_NAME(std::pair<const int COMMA Entity>);
 
     /********************/
     /* STL common types */
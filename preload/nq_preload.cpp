@@ -0,0 +1,283 @@
+/*
+** malloc interposition shim, built as libnq_memlib_preload.so:
+**
+**   LD_PRELOAD=libnq_memlib_preload.so ./closed_source_server
+**
+** malloc, calloc, realloc, free, posix_memalign... are served by the
+** glibc allocator (through the LibcAlloc AllocStrat) and logged in the
+** CurrentDomain of the thread, or in ExternalDomain outside of any
+** nq::domain_scope.
+** If NQ_MEMLIB_REPORT is set to a file path, a report is appended to it on
+** every SIGUSR1 (see nq_report.h).
+**
+** Nothing called from here may call malloc, it would come back here.
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../include/nq_memlib/lib_domains.h"
+#include "../include/nq_memlib/nq_memlib_tools.h"
+#include "../include/nq_memlib/nq_report.h"
+
+/* the glibc allocator, always reachable whatever is interposed */
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_memalign(size_t align, size_t size);
+    void* __libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+namespace
+{
+    struct LibcAlloc
+    {
+        void* allocate(std::size_t size, std::size_t align)
+        {
+            if (align <= min_align)
+                return __libc_malloc(size);
+            return __libc_memalign(align, size);
+        }
+
+        void deallocate(void *ptr)
+        {
+            __libc_free(ptr);
+        }
+
+        /* alignment of __libc_malloc */
+        enum { min_align = 2 * sizeof (size_t) };
+    };
+
+    /*
+    ** The Tag is placed right before the user pointer, after the SubHeader.
+    ** Its magic tells the pointers allocated here from the ones allocated
+    ** before the shim was loaded (by the dynamic loader) or by
+    ** __libc_realloc. It is keyed by the address of the Tag, so neither the
+    ** bytes before a foreign pointer nor a Tag copied elsewhere match it,
+    ** and it is cleared by free.
+    */
+    struct Tag
+    {
+        size_t size; // size asked by the user
+        size_t offset; // distance between the glibc pointer and the user one
+        size_t unused;
+        size_t magic;
+    };
+
+    const size_t tag_magic = static_cast<size_t>(0x6e716d656d6c6962ULL);
+    const size_t prefix_size = BaseDomain::sub_header_size + sizeof (Tag);
+
+    inline Tag* get_tag(void *usr_ptr)
+    {
+        return reinterpret_cast<Tag*>(
+                nq::memlib::get_internal_ptr(static_cast<char*>(usr_ptr),
+                    sizeof (Tag)));
+    }
+
+    inline size_t tag_key(const Tag *tag)
+    {
+        return tag_magic ^ reinterpret_cast<uintptr_t>(tag);
+    }
+
+    /*
+    ** The Tag of a foreign pointer at the start of a page would be on the
+    ** previous page, which may not be mapped: mincore tells it without
+    ** faulting. The Tags of the shim are always in their allocation.
+    */
+    bool tag_readable(void *usr_ptr)
+    {
+        static const uintptr_t page = sysconf(_SC_PAGESIZE);
+        const uintptr_t address = reinterpret_cast<uintptr_t>(usr_ptr);
+        if ((address & (page - 1)) >= sizeof (Tag))
+            return true;
+        if (address < sizeof (Tag))
+            return false;
+        unsigned char resident;
+        return mincore(reinterpret_cast<void*>(
+                    (address - sizeof (Tag)) & ~(page - 1)), 1, &resident)
+            == 0;
+    }
+
+    inline bool is_ours(void *usr_ptr)
+    {
+        if (!tag_readable(usr_ptr))
+            return false;
+        const Tag *tag = get_tag(usr_ptr);
+        return tag->magic == tag_key(tag);
+    }
+
+    void* shim_alloc(size_t size, size_t align)
+    {
+        if (align < LibcAlloc::min_align)
+            align = LibcAlloc::min_align;
+        /* the prefix is rounded so the user pointer keeps the alignment */
+        const size_t offset = (prefix_size + align - 1) & ~(align - 1);
+        if (size > SIZE_MAX - offset)
+            return nullptr;
+        nq::memlib::no_alloc_check(size);
+
+        char *internal_ptr = static_cast<char*>(
+                LibcAlloc().allocate(offset + size, align));
+        if (internal_ptr == nullptr)
+            return nullptr;
+        char *usr_ptr = internal_ptr + offset;
+
+        Tag *tag = get_tag(usr_ptr);
+        tag->size = size;
+        tag->offset = offset;
+        tag->unused = 0;
+        tag->magic = tag_key(tag);
+
+        BaseDomain *dom = nq::memlib::current_domain();
+        if (dom == nullptr)
+            dom = &ExternalDomain::getInstance();
+        dom->add(nq::memlib::get_internal_ptr(usr_ptr, prefix_size), size,
+                nullptr, 0, dom);
+        return usr_ptr;
+    }
+
+    void shim_free(void *usr_ptr)
+    {
+        if (usr_ptr == nullptr)
+            return;
+        if (!is_ours(usr_ptr))
+        {
+            __libc_free(usr_ptr);
+            return;
+        }
+        Tag *tag = get_tag(usr_ptr);
+        tag->magic = 0;
+        nq::memlib::remove_header_operator_delete(
+                nq::memlib::get_internal_ptr(usr_ptr, prefix_size));
+        LibcAlloc().deallocate(static_cast<char*>(usr_ptr) - tag->offset);
+    }
+
+    inline bool is_valid_align(size_t align)
+    {
+        return align != 0 && (align & (align - 1)) == 0;
+    }
+
+    /* only called for the pointers allocated before the shim was loaded */
+    size_t libc_usable_size(void *ptr)
+    {
+        typedef size_t (*usable_size_fun)(void*);
+        static usable_size_fun fun = reinterpret_cast<usable_size_fun>(
+                dlsym(RTLD_NEXT, "malloc_usable_size"));
+        return fun != nullptr ? fun(ptr) : 0;
+    }
+
+    __attribute__((constructor))
+    void start_report()
+    {
+        const char* filepath = std::getenv("NQ_MEMLIB_REPORT");
+        if (filepath != nullptr)
+            nq::log::start_report_thread(filepath);
+    }
+} // namespace
+
+extern "C"
+{
+    void* malloc(size_t size) noexcept
+    {
+        void *ptr = shim_alloc(size, 0);
+        if (ptr == nullptr)
+            errno = ENOMEM;
+        return ptr;
+    }
+
+    void free(void *ptr) noexcept
+    {
+        shim_free(ptr);
+    }
+
+    void* calloc(size_t count, size_t size) noexcept
+    {
+        if (size != 0 && count > SIZE_MAX / size)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        void *ptr = malloc(count * size);
+        if (ptr != nullptr)
+            std::memset(ptr, 0, count * size);
+        return ptr;
+    }
+
+    void* realloc(void *ptr, size_t size) noexcept
+    {
+        if (ptr == nullptr)
+            return malloc(size);
+        if (size == 0)
+        {
+            free(ptr);
+            return nullptr;
+        }
+        if (!is_ours(ptr))
+            return __libc_realloc(ptr, size);
+
+        void *new_ptr = malloc(size);
+        if (new_ptr == nullptr)
+            return nullptr;
+        const size_t old_size = get_tag(ptr)->size;
+        std::memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        free(ptr);
+        return new_ptr;
+    }
+
+    int posix_memalign(void **res, size_t align, size_t size) noexcept
+    {
+        if (!is_valid_align(align) || align % sizeof (void*) != 0)
+            return EINVAL;
+        void *ptr = shim_alloc(size, align);
+        if (ptr == nullptr)
+            return ENOMEM;
+        *res = ptr;
+        return 0;
+    }
+
+    void* memalign(size_t align, size_t size) noexcept
+    {
+        if (!is_valid_align(align))
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+        void *ptr = shim_alloc(size, align);
+        if (ptr == nullptr)
+            errno = ENOMEM;
+        return ptr;
+    }
+
+    void* aligned_alloc(size_t align, size_t size) noexcept
+    {
+        return memalign(align, size);
+    }
+
+    void* valloc(size_t size) noexcept
+    {
+        return memalign(sysconf(_SC_PAGESIZE), size);
+    }
+
+    void* pvalloc(size_t size) noexcept
+    {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        return memalign(page, (size + page - 1) & ~(page - 1));
+    }
+
+    /* the glibc one would count the prefix as usable */
+    size_t malloc_usable_size(void *ptr) noexcept
+    {
+        if (ptr == nullptr)
+            return 0;
+        if (!is_ours(ptr))
+            return libc_usable_size(ptr);
+        return get_tag(ptr)->size;
+    }
+}
@@ -1,7 +1,105 @@
 #include "../include/nq_memlib/base_domain.h"
+#include "../include/nq_memlib/pool_alloc.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <thread>
 
+namespace nq { namespace memlib {
+    TrackingLevel tracking_level_from_string(const char* name,
+            TrackingLevel dflt)
+    {
+        if (std::strcmp(name, "off") == 0)
+            return track_off;
+        if (std::strcmp(name, "counters") == 0)
+            return track_counters;
+        if (std::strcmp(name, "sampled") == 0)
+            return track_sampled;
+        if (std::strcmp(name, "full") == 0)
+            return track_full;
+        return dflt;
+    }
+
+    const char* tracking_level_to_string(TrackingLevel level)
+    {
+        switch (level)
+        {
+            case track_off:
+                return "off";
+            case track_counters:
+                return "counters";
+            case track_sampled:
+                return "sampled";
+            case track_full:
+                return "full";
+        }
+        return "unknown";
+    }
+
+    namespace
+    {
+        std::atomic<size_t> nb_threads(0);
+        /* a trivial thread_local: no TLS constructor on the allocation path */
+        thread_local size_t this_thread_index = tracked_threads;
+    }
+
+    size_t thread_index()
+    {
+        if (this_thread_index == tracked_threads)
+        {
+            size_t index = nb_threads.fetch_add(1, std::memory_order_relaxed);
+            this_thread_index = index < tracked_threads - 1
+                ? index : tracked_threads - 1;
+        }
+        return this_thread_index;
+    }
+
+    namespace
+    {
+        std::mutex types_mutex;
+        /* the name of each type id, written once under types_mutex */
+        std::atomic<const char*> type_names[tracked_types];
+        size_t nb_types = 1; // 0 is the id of the allocations without type
+    }
+
+    size_t register_type(const char* name)
+    {
+        std::lock_guard<std::mutex> locker(types_mutex);
+        for (size_t id = 1; id < nb_types; ++id)
+        {
+            if (std::strcmp(type_names[id].load(std::memory_order_relaxed),
+                        name) == 0)
+                return id;
+        }
+        if (nb_types == tracked_types)
+            return 0;
+        type_names[nb_types].store(name, std::memory_order_release);
+        return nb_types++;
+    }
+
+    const char* type_name(size_t id)
+    {
+        return id < tracked_types
+            ? type_names[id].load(std::memory_order_acquire) : nullptr;
+    }
+
+    void set_tracking_level(TrackingLevel level)
+    {
+        AllDomains::getInstance().for_each(
+            [level](BaseDomain& dom){ dom.set_level(level); });
+    }
+
+    bool set_tracking_level(const char* domain_name, TrackingLevel level)
+    {
+        BaseDomain *dom = AllDomains::getInstance().find(domain_name);
+        if (dom == nullptr)
+            return false;
+        dom->set_level(level);
+        return true;
+    }
+}} // namespace nq::memlib
+
 #ifdef WITH_NQ_MEMLOG
 void BaseDomain::Header::add(Header* next)
 {
@@ -15,6 +113,13 @@ void BaseDomain::Header::remove()
     if (prev_ != nullptr)
         prev_->next_ = next_;
 }
+void BaseDomain::Header::insert_after(Header *prev)
+{
+    prev_ = prev;
+    next_ = prev->next_;
+    next_->prev_ = this;
+    prev->next_ = this;
+}
 BaseDomain::Header* BaseDomain::Header::remove_begin()
 {
     if (next_ != nullptr)
@@ -31,6 +136,14 @@ BaseDomain::Header* BaseDomain::Header::remove_end()
 void BaseDomain::Header::print(std::ostream& os = std::cout,
         size_t tree_height = 0) const
 {
+    /* a snapshot in progress, not an allocation */
+    if (is_cursor())
+    {
+        if (next_ != nullptr)
+            next_->print(os, tree_height);
+        return;
+    }
+
     /* add tree_height tabs to the string */
     std::string tabs = "";
     std::generate_n(std::back_inserter(tabs), tree_height,
@@ -39,11 +152,11 @@ void BaseDomain::Header::print(std::ostream& os = std::cout,
     os << tabs << "size: " << size_ << std::endl;
 
     /*
-    ** If padding_ is 1 then we are in the case of a sub_header
+    ** If the sub_header flag is set then we are in the case of a sub_header
     ** If the file logged if null then it is an internal implementation use
     ** of new so it shouldn't be logged
     */
-    if (padding_ == 1 && (static_cast<const SubHeader*>(this))->get_file())
+    if (is_sub_header() && (static_cast<const SubHeader*>(this))->get_file())
     {
         os << tabs << "Is a new, @ File: "
             << (static_cast<const SubHeader*>(this))->get_file()
@@ -53,37 +166,55 @@ void BaseDomain::Header::print(std::ostream& os = std::cout,
     if (next_ != nullptr)
         next_->print(os, tree_height);
 }
-void BaseDomain::add(void* internal_ptr, std::size_t size)
+void BaseDomain::track(Header *head)
 {
-    /* basic mutex locking */
-    std::lock_guard<std::mutex> locker(mutex_);
+    head->set_thread(nq::memlib::thread_index());
+    attach(head);
+}
 
-    /* Construct a Header to the internal_ptr */
-    Header* head = new (internal_ptr)Header(size);
-    /* When adding the first element we initialize begin_ and end_ */
-    if (begin_ == nullptr)
+void BaseDomain::attach(Header *head)
+{
+    const nq::memlib::TrackingLevel level = get_level();
+
+    /*
+    ** At the sampled level the counters stay exact, only one Header in
+    ** sample_rate_ is listed (for the call sites and the leaks dumps)
+    */
+    bool listed = level == nq::memlib::track_full
+        || (level == nq::memlib::track_sampled
+            && sample_tick_.fetch_add(1, std::memory_order_relaxed)
+                % get_sample_rate() == 0);
+
+    if (head->is_huge())
+        huge_size_.fetch_add(head->size(), std::memory_order_relaxed);
+    if (head->is_prefaulted())
+        faulted_size_.fetch_add(head->size(), std::memory_order_relaxed);
+    if (thread_stats_)
+        thread_counters_[head->thread()].live.fetch_add(head->size(),
+                std::memory_order_relaxed);
+    /* the allocations without type (id 0) aren't counted */
+    if (head->type() != 0)
     {
-        end_ = head;
-        begin_ = end_;
+        type_count_[head->type()].fetch_add(1, std::memory_order_relaxed);
+        type_live_[head->type()].fetch_add(head->size(),
+                std::memory_order_relaxed);
     }
-    /* otherwise we push back our element and put end_ up-to-date */
-    else
+    if (profile_stats_)
+        profile_add(head->size());
+
+    if (!listed)
     {
-        end_->add(head);
-        end_ = head;
+        head->set_flags(Header::counted_flag);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        size_.fetch_add(head->size(), std::memory_order_relaxed);
+        return;
     }
-    count_++;
-    size_ += size;
-}
-void BaseDomain::add(void* internal_ptr, std::size_t size,
-        const char* file, size_t line, BaseDomain *dom)
-{
-    /* basic mutex locking */
-    std::lock_guard<std::mutex> locker(mutex_);
 
-    /* Construct a Header to the internal_ptr */
+    head->set_flags(Header::counted_flag | Header::listed_flag);
+
+    /* basic mutex locking */
+    std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
 
-    Header *head = new (internal_ptr)SubHeader(size, file, line, dom);
     /* When adding the first element we initialize begin_ and end_ */
     if (begin_ == nullptr)
     {
@@ -97,20 +228,54 @@ void BaseDomain::add(void* internal_ptr, std::size_t size,
         end_ = head;
     }
     // increment domain specific infos
-    count_++;
-    size_ += size;
+    count_.fetch_add(1, std::memory_order_relaxed);
+    size_.fetch_add(head->size(), std::memory_order_relaxed);
 }
 
-void BaseDomain::remove(void *internal_ptr)
+void BaseDomain::untrack(Header *ptr, bool freed)
 {
+    if (ptr->is_huge())
+        huge_size_.fetch_sub(ptr->size(), std::memory_order_relaxed);
+    if (ptr->is_prefaulted())
+        faulted_size_.fetch_sub(ptr->size(), std::memory_order_relaxed);
+    if (thread_stats_)
+    {
+        thread_counters_[ptr->thread()].live.fetch_sub(ptr->size(),
+                std::memory_order_relaxed);
+        if (freed)
+            thread_counters_[nq::memlib::thread_index()].frees[ptr->thread()]
+                .fetch_add(1, std::memory_order_relaxed);
+    }
+    if (ptr->type() != 0)
+    {
+        type_count_[ptr->type()].fetch_sub(1, std::memory_order_relaxed);
+        type_live_[ptr->type()].fetch_sub(ptr->size(),
+                std::memory_order_relaxed);
+    }
+    if (profile_stats_)
+        profile_remove(ptr->size());
+    if (soft_crossed_.load(std::memory_order_relaxed)
+            && get_size() - ptr->size() < get_soft_quota())
+        set_quota(get_soft_quota(), get_hard_quota());
+
+    if (!ptr->is_listed())
+    {
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        size_.fetch_sub(ptr->size(), std::memory_order_relaxed);
+        return;
+    }
+
     /* basic mutex locking */
-    std::lock_guard<std::mutex> locker(mutex_);
-    Header* ptr = static_cast<Header*>(internal_ptr);
+    std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
 
     // decrement domain specific infos
-    count_--;
-    size_ -= ptr->size();
+    count_.fetch_sub(1, std::memory_order_relaxed);
+    size_.fetch_sub(ptr->size(), std::memory_order_relaxed);
+    unlink(ptr);
+}
 
+void BaseDomain::unlink(Header *ptr)
+{
     /* Check if tmp is the begin or the end of the Domain list and
      * call the appropriate remove in consequences */
     if (ptr == begin_)
@@ -119,8 +284,188 @@ void BaseDomain::remove(void *internal_ptr)
         end_ = ptr->remove_end();
     if (ptr != begin_ && ptr != end_ && ptr != nullptr)
         ptr->remove();
-    /* Destructor called */
-    ptr->~Header();
+}
+
+void BaseDomain::retag(void *internal_ptr, BaseDomain& to)
+{
+    Header *head = static_cast<Header*>(internal_ptr);
+    if (&to == this)
+        return;
+    to.check_quota(head->size());
+
+    if (head->is_counted())
+        untrack(head, false);
+    head->detach();
+    if (head->is_sub_header())
+        static_cast<SubHeader*>(head)->set_domain(&to);
+    if (to.get_level() != nq::memlib::track_off)
+        to.attach(head);
+}
+
+void BaseDomain::resize(void *internal_ptr, size_t size, size_t backing)
+{
+    Header *head = static_cast<Header*>(internal_ptr);
+    const size_t old_size = head->size();
+    if (!head->is_counted())
+    {
+        head->set_size(size, backing_flags(backing));
+        return;
+    }
+
+    if (head->is_huge())
+        huge_size_.fetch_sub(old_size, std::memory_order_relaxed);
+    if (head->is_prefaulted())
+        faulted_size_.fetch_sub(old_size, std::memory_order_relaxed);
+    /* the unsigned differences wrap back when the memory shrinks */
+    if (thread_stats_)
+        thread_counters_[head->thread()].live.fetch_add(size - old_size,
+                std::memory_order_relaxed);
+    if (head->type() != 0)
+        type_live_[head->type()].fetch_add(size - old_size,
+                std::memory_order_relaxed);
+    if (profile_stats_)
+    {
+        profile_remove(old_size);
+        profile_add(size);
+    }
+    size_.fetch_add(size - old_size, std::memory_order_relaxed);
+
+    /* snapshot and print read the size of the listed Headers */
+    if (head->is_listed())
+    {
+        std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
+        head->set_size(size, backing_flags(backing));
+    }
+    else
+        head->set_size(size, backing_flags(backing));
+
+    if (head->is_huge())
+        huge_size_.fetch_add(size, std::memory_order_relaxed);
+    if (head->is_prefaulted())
+        faulted_size_.fetch_add(size, std::memory_order_relaxed);
+    if (soft_crossed_.load(std::memory_order_relaxed)
+            && get_size() < get_soft_quota())
+        set_quota(get_soft_quota(), get_hard_quota());
+}
+
+void BaseDomain::set_quota(size_t soft, size_t hard)
+{
+    soft_quota_.store(soft, std::memory_order_relaxed);
+    hard_quota_.store(hard, std::memory_order_relaxed);
+    soft_crossed_.store(false, std::memory_order_relaxed);
+    quota_trigger_.store(soft < hard ? soft : hard,
+            std::memory_order_relaxed);
+}
+
+bool BaseDomain::add_quota_callback(nq::memlib::QuotaCallback callback)
+{
+    for (size_t index = 0; index < max_quota_callbacks; ++index)
+    {
+        nq::memlib::QuotaCallback empty = nullptr;
+        if (quota_callbacks_[index].compare_exchange_strong(empty, callback))
+            return true;
+    }
+    return false;
+}
+
+void BaseDomain::remove_quota_callback(nq::memlib::QuotaCallback callback)
+{
+    for (size_t index = 0; index < max_quota_callbacks; ++index)
+    {
+        nq::memlib::QuotaCallback registered = callback;
+        quota_callbacks_[index].compare_exchange_strong(registered, nullptr);
+    }
+}
+
+void BaseDomain::quota_exceeded(size_t size)
+{
+    if (get_size() + size > get_hard_quota())
+    {
+        nq::memlib::QuotaHandler handler =
+            quota_handler_.load(std::memory_order_relaxed);
+        if (handler == nullptr || !handler(*this, size))
+            throw nq::memlib::domain_bad_alloc(domain_name());
+        return;
+    }
+
+    /* the soft quota: once until the Domain goes back under it */
+    if (soft_crossed_.exchange(true, std::memory_order_relaxed))
+        return;
+    quota_trigger_.store(get_hard_quota(), std::memory_order_relaxed);
+    for (size_t index = 0; index < max_quota_callbacks; ++index)
+    {
+        nq::memlib::QuotaCallback callback =
+            quota_callbacks_[index].load(std::memory_order_relaxed);
+        if (callback != nullptr)
+            callback(*this, size);
+    }
+}
+
+static_assert(nq::memlib::tracked_threads <= 0x100
+        && nq::memlib::tracked_types <= 0x100,
+        "The thread and type ids are kept on 8 bits of the Header flags");
+
+static_assert(BaseDomain::profile_classes
+        == nq::memlib::SlabPool::nb_classes + 1,
+        "A profile class per size class of the pools, plus the big ones");
+
+void BaseDomain::profile_add(size_t size)
+{
+    const size_t index = nq::memlib::SlabPool::class_of(size, 1);
+    /* the big allocations are counted in bytes */
+    const size_t amount = index == nq::memlib::SlabPool::nb_classes ? size : 1;
+    size_t live = class_live_[index].fetch_add(amount,
+            std::memory_order_relaxed) + amount;
+
+    size_t peak = class_peak_[index].load(std::memory_order_relaxed);
+    while (live > peak && !class_peak_[index].compare_exchange_weak(peak,
+                live, std::memory_order_relaxed))
+        ;
+}
+
+void BaseDomain::profile_remove(size_t size)
+{
+    const size_t index = nq::memlib::SlabPool::class_of(size, 1);
+    const size_t amount = index == nq::memlib::SlabPool::nb_classes ? size : 1;
+    class_live_[index].fetch_sub(amount, std::memory_order_relaxed);
+}
+
+BaseDomain* BaseDomain::find(const char* name)
+{
+    BaseDomain *found = nullptr;
+    for_each([name, &found](BaseDomain& dom)
+    {
+        if (found == nullptr && std::strcmp(dom.domain_name(), name) == 0)
+            found = &dom;
+    });
+    return found;
+}
+
+void BaseDomain::init_from_env()
+{
+    /*
+    ** No std::string here, the Domains can be constructed from inside an
+    ** allocation.
+    */
+    const char level_var[] = "NQ_MEMLIB_LEVEL";
+    const char rate_var[] = "NQ_MEMLIB_SAMPLE_RATE";
+    char name[128];
+
+    const char* value = std::getenv(level_var);
+    if (value != nullptr)
+        set_level(nq::memlib::tracking_level_from_string(value, get_level()));
+    std::snprintf(name, sizeof (name), "%s_%s", level_var, domain_name());
+    value = std::getenv(name);
+    if (value != nullptr)
+        set_level(nq::memlib::tracking_level_from_string(value, get_level()));
+
+    value = std::getenv(rate_var);
+    if (value != nullptr)
+        set_sample_rate(std::strtoul(value, nullptr, 10));
+    std::snprintf(name, sizeof (name), "%s_%s", rate_var, domain_name());
+    value = std::getenv(name);
+    if (value != nullptr)
+        set_sample_rate(std::strtoul(value, nullptr, 10));
 }
 
 void BaseDomain::print(std::ostream& os, size_t tree_height) const
@@ -130,18 +475,26 @@ void BaseDomain::print(std::ostream& os, size_t tree_height) const
     std::generate_n(std::back_inserter(tabs), tree_height,
             [](){return '\t';});
 
-    std::lock_guard<std::mutex> locker(mutex_);
+    std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
 
         os << "--------------------" << std::endl;
-        os << tabs << domain_name() << std::endl;
+        os << tabs << domain_name() << " ("
+            << nq::memlib::tracking_level_to_string(get_level()) << ")"
+            << std::endl;
 
         /* Recover the SubDomains nb_alloc and size_alloc infos */
         std::tuple<int, int> tree_tuple = Super::get_branch_infos();
 
         os << tabs << "nb_alloc with sons: " << std::get<0>(tree_tuple)
-                << "  (nb_alloc : " << count_ << ")\n"
+                << "  (nb_alloc : " << get_count() << ")\n"
                 << tabs << "size_alloc with sons: " << std::get<1>(tree_tuple)
-                << "  (size_alloc : " << size_ << ")\n";
+                << "  (size_alloc : " << get_size() << ")\n";
+        if (get_huge_size() != 0)
+            os << tabs << "huge_pages: " << get_huge_size() << "\n";
+        if (get_faulted_size() != 0 || get_reserved_size() != 0)
+            os << tabs << "prefaulted: " << get_faulted_size()
+                << "  (reserved : " << get_reserved_size() << ")\n";
+        print_breakdown(os, tabs);
 
     if (begin_ != nullptr)
         begin_->print(os, tree_height + 1);
@@ -152,4 +505,161 @@ void BaseDomain::print(std::ostream& os, size_t tree_height) const
     if (Super::brothers_ != nullptr)
         Super::brothers_->print(os, tree_height);
 }
+
+void BaseDomain::print_latency(std::ostream& os, const std::string& tabs,
+        const char* name, const nq::memlib::LatencySnapshot& latency)
+{
+    if (latency.count == 0)
+        return;
+    os << tabs << name << " latency (ns): p50: " << latency.p50
+        << ", p99: " << latency.p99 << ", p999: " << latency.p999
+        << "  (calls : " << latency.count << ")\n";
+}
+
+void BaseDomain::print_breakdown(std::ostream& os,
+        const std::string& tabs) const
+{
+    bool first = true;
+    for (size_t index = 0; index < nq::memlib::tracked_threads; ++index)
+    {
+        if (get_thread_live(index) == 0)
+            continue;
+        if (first)
+            os << tabs << "live per thread:";
+        else
+            os << ",";
+        os << " " << index << ": " << get_thread_live(index);
+        first = false;
+    }
+    if (!first)
+        os << "\n";
+
+    /* the frees made by another thread than the allocating one */
+    first = true;
+    for (size_t alloc = 0; alloc < nq::memlib::tracked_threads; ++alloc)
+    {
+        for (size_t index = 0; index < nq::memlib::tracked_threads; ++index)
+        {
+            if (index == alloc || get_thread_frees(alloc, index) == 0)
+                continue;
+            if (first)
+                os << tabs << "remote frees:";
+            else
+                os << ",";
+            os << " " << alloc << "->" << index << ": "
+                << get_thread_frees(alloc, index);
+            first = false;
+        }
+    }
+    if (!first)
+        os << "\n";
+
+    if (get_lock_contended() != 0)
+        os << tabs << "mutex contended: " << get_lock_contended()
+            << "  (uncontended : " << get_lock_uncontended()
+            << ", waited : " << get_lock_wait_ns() << " ns)\n";
+    print_latency(os, tabs, "strategy", strategy_latency_.snapshot());
+    print_latency(os, tabs, "domain", domain_latency_.snapshot());
+
+    /* the allocations counted per type (see type_stats) */
+    for (size_t id = 1; id < nq::memlib::tracked_types; ++id)
+    {
+        if (get_type_count(id) == 0)
+            continue;
+        os << tabs << "type " << nq::memlib::type_name(id) << ": nb_alloc: "
+            << get_type_count(id) << ", size_alloc: " << get_type_live(id)
+            << "\n";
+    }
+}
+
+void BaseDomain::snapshot(std::vector<DomainSnapshot>& snaps, size_t depth)
+{
+    snaps.push_back(DomainSnapshot());
+    DomainSnapshot& snap = snaps.back();
+    snap.name = domain_name();
+    snap.depth = depth;
+    snap.level = get_level();
+    snap.truncated = false;
+
+    /*
+    ** Reserve the call sites buffer before locking, allocating under mutex_
+    ** could come back in this very Domain. Some headroom is taken for the
+    ** allocations made between the reserve and the lock.
+    */
+    snap.sites.reserve(get_count() + get_count() / 8 + 16);
+    {
+        std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
+
+        snap.count = get_count();
+        snap.size = get_size();
+        snap.huge_size = get_huge_size();
+        snap.faulted_size = get_faulted_size();
+        snap.reserved_size = get_reserved_size();
+        snap.strategy_latency = strategy_latency_.snapshot();
+        snap.domain_latency = domain_latency_.snapshot();
+        snap.lock_uncontended = get_lock_uncontended();
+        snap.lock_contended = get_lock_contended();
+        snap.lock_wait_ns = get_lock_wait_ns();
+        for (size_t id = 0; id < nq::memlib::tracked_types; ++id)
+        {
+            snap.type_count[id] = get_type_count(id);
+            snap.type_live[id] = get_type_live(id);
+        }
+        for (size_t alloc = 0; alloc < nq::memlib::tracked_threads; ++alloc)
+        {
+            snap.thread_live[alloc] = get_thread_live(alloc);
+            for (size_t index = 0; index < nq::memlib::tracked_threads;
+                    ++index)
+                snap.thread_frees[alloc][index] =
+                    get_thread_frees(alloc, index);
+        }
+    }
+
+    /*
+    ** mutex_ is released every snapshot_chunk Headers, the cursor is linked
+    ** after the last Header copied to resume from there. The Headers freed
+    ** in between are unlinked before the cursor as any other.
+    */
+    Header cursor(0, Header::cursor_flag);
+    bool linked = false;
+    do
+    {
+        std::lock_guard<nq::memlib::ContendedMutex> locker(mutex_);
+
+        Header *it = begin_;
+        if (linked)
+        {
+            it = cursor.next();
+            unlink(&cursor);
+        }
+        Header *last = nullptr;
+        for (size_t walked = 0; it != nullptr && walked < snapshot_chunk;
+                last = it, it = it->next(), ++walked)
+        {
+            /* the other snapshots' cursors are not sub headers either */
+            if (!it->is_sub_header())
+                continue;
+            const SubHeader *sub = static_cast<const SubHeader*>(it);
+            /* internal uses of new are not logged with a file */
+            if (sub->get_file() == nullptr)
+                continue;
+            if (snap.sites.size() == snap.sites.capacity())
+            {
+                snap.truncated = true;
+                break;
+            }
+            CallSiteSnapshot site = { sub->get_file(), sub->get_line(),
+                sub->size() };
+            snap.sites.push_back(site);
+        }
+        linked = it != nullptr && !snap.truncated;
+        if (linked)
+            cursor.insert_after(last);
+    } while (linked);
+
+    if (Super::sons_ != nullptr)
+        static_cast<BaseDomain*>(Super::sons_)->snapshot(snaps, depth + 1);
+    if (Super::brothers_ != nullptr)
+        static_cast<BaseDomain*>(Super::brothers_)->snapshot(snaps, depth);
+}
 #endif // WITH_NQ_MEMLOG
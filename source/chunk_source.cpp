@@ -0,0 +1,213 @@
+#include "../include/nq_memlib/chunk_source.h"
+#include "../include/nq_memlib/env_maccro.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef NQ_WIN_
+# include <malloc.h>
+#else // NQ_WIN_
+# include <sys/mman.h>
+# ifdef __linux__
+#  include <sys/syscall.h>
+#  include <unistd.h>
+# endif // !__linux__
+#endif // !NQ_WIN_
+
+namespace
+{
+    /* -1 while NQ_MEMLIB_HUGETLB has not been read */
+    std::atomic<int> use_hugetlb(-1);
+
+#ifndef NQ_WIN_
+    /* map size bytes aligned on align, by unmapping what is around them */
+    void* map_aligned(std::size_t size, std::size_t align)
+    {
+        char *ptr = static_cast<char*>(mmap(nullptr, size + align,
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0));
+        if (ptr == MAP_FAILED)
+            return nullptr;
+
+        char *aligned = reinterpret_cast<char*>(
+                (reinterpret_cast<std::uintptr_t>(ptr) + align - 1)
+                & ~(static_cast<std::uintptr_t>(align) - 1));
+        if (aligned != ptr)
+            munmap(ptr, aligned - ptr);
+        munmap(aligned + size, ptr + align - aligned);
+        return aligned;
+    }
+
+    /*
+    ** madvise(MADV_HUGEPAGE) succeeds even when the transparent huge pages
+    ** are disabled at runtime, it is then not counted as huge
+    */
+    bool transparent_huge_pages()
+    {
+        static const bool enabled = []()
+        {
+            std::FILE *file = std::fopen(
+                    "/sys/kernel/mm/transparent_hugepage/enabled", "r");
+            if (file == nullptr)
+                return false;
+            char mode[128] = { 0 };
+            bool read = std::fgets(mode, sizeof (mode), file) != nullptr;
+            std::fclose(file);
+            return read && std::strstr(mode, "[never]") == nullptr;
+        }();
+        return enabled;
+    }
+
+    /*
+    ** mbind(MPOL_PREFERRED) the untouched pages of a chunk on node, they
+    ** fall back on the other nodes when it is full. Without the syscall
+    ** the pages stay on the node of the thread touching them first.
+    */
+    void bind_to_node(void *ptr, std::size_t size, int node)
+    {
+# if defined(__linux__) && defined(SYS_mbind)
+        const int mpol_preferred = 1;
+        const std::size_t bits = 8 * sizeof (unsigned long);
+        unsigned long mask[1024 / (8 * sizeof (unsigned long))] = { 0 };
+
+        if (node < 0 || static_cast<std::size_t>(node) >= 1024)
+            return;
+        mask[node / bits] = 1UL << (node % bits);
+        syscall(SYS_mbind, ptr, size, mpol_preferred, mask,
+                static_cast<unsigned long>(1024), 0U);
+# else // __linux__ && SYS_mbind
+        (void)ptr;
+        (void)size;
+        (void)node;
+# endif // !__linux__ && SYS_mbind
+    }
+#endif // !NQ_WIN_
+} // namespace
+
+namespace nq { namespace memlib
+{
+    void set_use_hugetlb(bool use)
+    {
+        use_hugetlb.store(use ? 1 : 0, std::memory_order_relaxed);
+    }
+
+    bool get_use_hugetlb()
+    {
+        int use = use_hugetlb.load(std::memory_order_relaxed);
+        if (use < 0)
+        {
+            const char *value = std::getenv("NQ_MEMLIB_HUGETLB");
+            use = value != nullptr && std::atoi(value) != 0;
+            use_hugetlb.store(use, std::memory_order_relaxed);
+        }
+        return use != 0;
+    }
+
+    void prefault_chunk(void *chunk, std::size_t size)
+    {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(chunk, size, MADV_POPULATE_WRITE) == 0)
+            return;
+#endif // !MADV_POPULATE_WRITE
+        /* a write per page, no page is smaller */
+        volatile char *page = static_cast<char*>(chunk);
+        for (std::size_t offset = 0; offset < size; offset += 4096)
+            page[offset] = 0;
+    }
+
+    bool lock_chunk(void *chunk, std::size_t size)
+    {
+#ifndef NQ_WIN_
+        return mlock(chunk, size) == 0;
+#else // NQ_WIN_
+        (void)chunk;
+        (void)size;
+        return false;
+#endif // !NQ_WIN_
+    }
+
+#ifndef NQ_WIN_
+    void* PageSource::allocate_chunk(std::size_t size, int node,
+            ChunkPages& pages)
+    {
+        pages = regular_pages;
+        void *ptr = map_aligned(size, chunk_size);
+        if (ptr != nullptr && node >= 0)
+            bind_to_node(ptr, size, node);
+        return ptr;
+    }
+
+    void PageSource::deallocate_chunk(void *chunk, std::size_t size)
+    {
+        munmap(chunk, size);
+    }
+
+    void* HugePageSource::allocate_chunk(std::size_t size, int node,
+            ChunkPages& pages)
+    {
+# ifdef MAP_HUGETLB
+        /* the kernel aligns the huge page mappings on their size */
+        if (get_use_hugetlb())
+        {
+            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED)
+            {
+                if (node >= 0)
+                    bind_to_node(ptr, size, node);
+                pages = huge_pages;
+                return ptr;
+            }
+        }
+# endif // !MAP_HUGETLB
+
+        void *ptr = map_aligned(size, chunk_size);
+        pages = regular_pages;
+        if (ptr != nullptr && node >= 0)
+            bind_to_node(ptr, size, node);
+# ifdef MADV_HUGEPAGE
+        /*
+        ** fails when the kernel has no transparent huge pages, and even
+        ** then they are only given at fault time if some are free
+        */
+        if (ptr != nullptr && transparent_huge_pages()
+                && madvise(ptr, size, MADV_HUGEPAGE) == 0)
+            pages = advised_pages;
+# endif // !MADV_HUGEPAGE
+        return ptr;
+    }
+
+    void HugePageSource::deallocate_chunk(void *chunk, std::size_t size)
+    {
+        munmap(chunk, size);
+    }
+
+#else // NQ_WIN_
+    /* the large pages of Windows need a privilege, regular pages are used */
+    void* PageSource::allocate_chunk(std::size_t size, int,
+            ChunkPages& pages)
+    {
+        pages = regular_pages;
+        return _aligned_malloc(size, chunk_size);
+    }
+
+    void PageSource::deallocate_chunk(void *chunk, std::size_t)
+    {
+        _aligned_free(chunk);
+    }
+
+    void* HugePageSource::allocate_chunk(std::size_t size, int node,
+            ChunkPages& pages)
+    {
+        return PageSource::allocate_chunk(size, node, pages);
+    }
+
+    void HugePageSource::deallocate_chunk(void *chunk, std::size_t size)
+    {
+        PageSource::deallocate_chunk(chunk, size);
+    }
+#endif // !NQ_WIN_
+}} // namespace nq::memlib
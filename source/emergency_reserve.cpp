@@ -0,0 +1,221 @@
+#include "../include/nq_memlib/emergency_reserve.h"
+#include "../include/nq_memlib/chunk_source.h"
+#include "../include/nq_memlib/nq_cgroup.h"
+
+#include <cstdint>
+
+namespace nq { namespace memlib
+{
+    /* the free blocks, in the free memory itself */
+    struct EmergencyReserve::FreeBlock
+    {
+        std::size_t size_;
+        FreeBlock *next_;
+    };
+
+    namespace
+    {
+        /* every block is a multiple of it, and starts aligned on it */
+        const std::size_t granularity = 16;
+
+        /* before the user memory of an allocated block */
+        struct BlockHeader
+        {
+            std::size_t size_; // of the whole block
+            std::size_t offset_; // from the block start to the user memory
+        };
+
+        std::size_t align_up(std::size_t size, std::size_t align)
+        {
+            return (size + align - 1) & ~(align - 1);
+        }
+
+        std::atomic<EmergencyReserve*> reserves(nullptr);
+    } // namespace
+
+    std::atomic<bool> EmergencyReserve::any_reserve_(false);
+
+    EmergencyReserve::EmergencyReserve(std::size_t size)
+        : size_(size),
+        nb_regions_(0),
+        free_size_(0)
+    {
+        static_assert(sizeof (BlockHeader) == granularity,
+                "The BlockHeader keeps the user memory aligned");
+        add_region(size);
+
+        next_reserve_ = reserves.load();
+        while (!reserves.compare_exchange_weak(next_reserve_, this))
+            ;
+        any_reserve_.store(true, std::memory_order_release);
+    }
+
+    /* a region of chunks taken and faulted in now */
+    bool EmergencyReserve::add_region(std::size_t size)
+    {
+        std::size_t index = nb_regions_.load(std::memory_order_relaxed);
+        if (size == 0 || index == max_regions)
+            return false;
+
+        size = align_up(size, PageSource::chunk_size);
+        ChunkPages pages = regular_pages;
+        void *chunk = PageSource::allocate_chunk(size, -1, pages);
+        if (chunk == nullptr)
+            return false;
+        prefault_chunk(chunk, size);
+
+        Region& region = regions_[index];
+        region.begin_ = static_cast<char*>(chunk);
+        region.end_ = region.begin_ + size;
+        region.free_ = static_cast<FreeBlock*>(chunk);
+        region.free_->size_ = size;
+        region.free_->next_ = nullptr;
+        free_size_.fetch_add(size, std::memory_order_relaxed);
+        /* owns() reads the regions without the mutex */
+        nb_regions_.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    void* EmergencyReserve::allocate_in(Region& region, std::size_t size,
+            std::size_t align)
+    {
+        if (align < granularity)
+            align = granularity;
+        for (FreeBlock **link = &region.free_; *link != nullptr;
+                link = &(*link)->next_)
+        {
+            FreeBlock *block = *link;
+            char *start = reinterpret_cast<char*>(block);
+            char *usr = reinterpret_cast<char*>(align_up(
+                        reinterpret_cast<std::uintptr_t>(start)
+                        + sizeof (BlockHeader), align));
+            std::size_t needed = align_up(usr + size - start, granularity);
+            if (needed > block->size_)
+                continue;
+
+            /* the end of the block stays free if it can hold a FreeBlock */
+            if (block->size_ - needed >= sizeof (FreeBlock))
+            {
+                FreeBlock *rest = reinterpret_cast<FreeBlock*>(start + needed);
+                rest->size_ = block->size_ - needed;
+                rest->next_ = block->next_;
+                *link = rest;
+            }
+            else
+            {
+                needed = block->size_;
+                *link = block->next_;
+            }
+
+            BlockHeader *header = reinterpret_cast<BlockHeader*>(usr) - 1;
+            header->size_ = needed;
+            header->offset_ = usr - start;
+            free_size_.fetch_sub(needed, std::memory_order_relaxed);
+            return usr;
+        }
+        return nullptr;
+    }
+
+    void* EmergencyReserve::allocate(std::size_t size,
+            std::size_t align) noexcept
+    {
+        void *ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            std::size_t nb_regions =
+                nb_regions_.load(std::memory_order_relaxed);
+            for (std::size_t index = 0; index < nb_regions && ptr == nullptr;
+                    ++index)
+                ptr = allocate_in(regions_[index], size, align);
+        }
+        /* the AllocStrat failed: let the process free what it can */
+        request_memory_pressure();
+        return ptr;
+    }
+
+    /* put the block back in the sorted free list, merged with its neighbors */
+    void EmergencyReserve::deallocate_in(Region& region, void *ptr)
+    {
+        BlockHeader *header = static_cast<BlockHeader*>(ptr) - 1;
+        char *start = static_cast<char*>(ptr) - header->offset_;
+        FreeBlock *block = reinterpret_cast<FreeBlock*>(start);
+        block->size_ = header->size_;
+        free_size_.fetch_add(block->size_, std::memory_order_relaxed);
+
+        FreeBlock *prev = nullptr;
+        FreeBlock *next = region.free_;
+        while (next != nullptr && next < block)
+        {
+            prev = next;
+            next = next->next_;
+        }
+
+        block->next_ = next;
+        if (next != nullptr
+                && start + block->size_ == reinterpret_cast<char*>(next))
+        {
+            block->size_ += next->size_;
+            block->next_ = next->next_;
+        }
+        if (prev != nullptr && reinterpret_cast<char*>(prev) + prev->size_
+                == start)
+        {
+            prev->size_ += block->size_;
+            prev->next_ = block->next_;
+        }
+        else if (prev != nullptr)
+            prev->next_ = block;
+        else
+            region.free_ = block;
+    }
+
+    bool EmergencyReserve::deallocate(void *ptr)
+    {
+        std::size_t nb_regions = nb_regions_.load(std::memory_order_acquire);
+        for (std::size_t index = 0; index < nb_regions; ++index)
+        {
+            Region& region = regions_[index];
+            if (ptr >= static_cast<void*>(region.begin_)
+                    && ptr < static_cast<void*>(region.end_))
+            {
+                std::lock_guard<std::mutex> locker(mutex_);
+                deallocate_in(region, ptr);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool EmergencyReserve::owns(const void *ptr) const
+    {
+        std::size_t nb_regions = nb_regions_.load(std::memory_order_acquire);
+        for (std::size_t index = 0; index < nb_regions; ++index)
+        {
+            if (ptr >= static_cast<const void*>(regions_[index].begin_)
+                    && ptr < static_cast<const void*>(regions_[index].end_))
+                return true;
+        }
+        return false;
+    }
+
+    bool EmergencyReserve::refill()
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        std::size_t free_size = get_free_size();
+        if (free_size >= size_)
+            return true;
+        return add_region(size_ - free_size);
+    }
+
+    bool EmergencyReserve::deallocate_any(void *ptr)
+    {
+        for (EmergencyReserve *reserve = reserves.load(
+                    std::memory_order_acquire);
+                reserve != nullptr; reserve = reserve->next_reserve_)
+        {
+            if (reserve->deallocate(ptr))
+                return true;
+        }
+        return false;
+    }
+}} // namespace nq::memlib
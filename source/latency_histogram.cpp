@@ -0,0 +1,51 @@
+#include "../include/nq_memlib/latency_histogram.h"
+
+namespace nq { namespace memlib
+{
+    uint64_t LatencyHistogram::percentile(double q) const
+    {
+        size_t counts[nb_buckets];
+        size_t total = 0;
+        for (size_t index = 0; index < nb_buckets; ++index)
+        {
+            counts[index] = buckets_[index].load(std::memory_order_relaxed);
+            total += counts[index];
+        }
+        if (total == 0)
+            return 0;
+
+        /* the rank of the quantile, at least the first duration */
+        size_t rank = static_cast<size_t>(q * total);
+        if (rank >= total)
+            rank = total - 1;
+        size_t seen = 0;
+        for (size_t index = 0; index < nb_buckets; ++index)
+        {
+            seen += counts[index];
+            if (seen > rank)
+                return index == 0 ? 0 : static_cast<uint64_t>(1) << index;
+        }
+        return static_cast<uint64_t>(1) << (nb_buckets - 1);
+    }
+
+    size_t LatencyHistogram::count() const
+    {
+        size_t total = 0;
+        for (size_t index = 0; index < nb_buckets; ++index)
+            total += buckets_[index].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    LatencySnapshot LatencyHistogram::snapshot() const
+    {
+        LatencySnapshot snap = { count(), percentile(0.5), percentile(0.99),
+            percentile(0.999) };
+        return snap;
+    }
+
+    void LatencyHistogram::reset()
+    {
+        for (size_t index = 0; index < nb_buckets; ++index)
+            buckets_[index].store(0, std::memory_order_relaxed);
+    }
+}} // namespace nq::memlib
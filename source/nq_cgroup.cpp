@@ -0,0 +1,318 @@
+#include "../include/nq_memlib/nq_cgroup.h"
+#include "../include/nq_memlib/lib_domains.h"
+#include "../include/nq_memlib/periodic_thread.h"
+#include "../include/nq_memlib/pool_alloc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    /* protects everything below but the pressure thread */
+    std::mutex state_mutex;
+    std::string cgroup_path;
+    bool cgroup_path_read = false;
+    /* the shares of the limit given to a Domain as its quotas */
+    struct Budget
+    {
+        std::string domain;
+        double share;
+        double hard_share;
+    };
+    std::vector<Budget> budgets;
+    double pool_cache_share = 0;
+    double pressure_threshold = 0.9;
+    std::vector<nq::memlib::PressureCallback> callbacks;
+
+    nq::memlib::PeriodicThread pressure_thread;
+    /* set by request_memory_pressure, served by check_memory_pressure */
+    std::atomic<bool> pressure_requested(false);
+
+    /* the cgroup of the process, "0::/path" in /proc/self/cgroup */
+    std::string default_cgroup_path()
+    {
+        const char *env = std::getenv("NQ_MEMLIB_CGROUP");
+        if (env != nullptr)
+            return env;
+
+        std::ifstream file("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, 3, "0::") == 0)
+                return "/sys/fs/cgroup" + line.substr(3);
+        }
+        return "/sys/fs/cgroup";
+    }
+
+    /* a number of bytes, or "max" */
+    bool read_cgroup_file(const std::string& filepath, size_t& value)
+    {
+        std::ifstream file(filepath.c_str());
+        std::string word;
+        if (!(file >> word))
+            return false;
+        if (word == "max")
+        {
+            value = nq::memlib::no_cgroup_limit;
+            return true;
+        }
+        char *end = nullptr;
+        value = std::strtoull(word.c_str(), &end, 10);
+        return end != word.c_str();
+    }
+
+    size_t share_of(size_t limit, double share)
+    {
+        if (limit == nq::memlib::no_cgroup_limit || share <= 0)
+            return 0;
+        return static_cast<size_t>(static_cast<double>(limit) * share);
+    }
+
+    /* share of limit as a Domain quota */
+    size_t quota_of(size_t limit, double share)
+    {
+        size_t quota = share_of(limit, share);
+        return quota == 0 ? BaseDomain::no_quota : quota;
+    }
+
+    /*
+    ** Set the quotas of the Domains with a budget from limit, state_mutex
+    ** held. The Domains not constructed yet get theirs at the next call.
+    */
+    void apply_budgets(size_t limit)
+    {
+        for (const Budget& budget : budgets)
+        {
+            BaseDomain *dom = AllDomains::getInstance().find(
+                    budget.domain.c_str());
+            if (dom == nullptr)
+                continue;
+            const size_t soft = quota_of(limit, budget.share);
+            const size_t hard = quota_of(limit, budget.hard_share);
+            /* set_quota would call the soft quota callbacks again */
+            if (dom->get_soft_quota() != soft || dom->get_hard_quota() != hard)
+                dom->set_quota(soft, hard);
+        }
+    }
+
+    /* the limit of the cgroup, no_cgroup_limit without one */
+    size_t read_limit()
+    {
+        nq::memlib::CgroupMemory memory;
+        if (!nq::memlib::read_cgroup_memory(memory))
+            return nq::memlib::no_cgroup_limit;
+        return memory.limit();
+    }
+
+    void pressure_task()
+    {
+        nq::memlib::check_memory_pressure();
+    }
+} // namespace
+
+namespace nq { namespace memlib {
+    void set_cgroup_path(const std::string& dirpath)
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        cgroup_path = dirpath;
+        cgroup_path_read = true;
+    }
+
+    std::string get_cgroup_path()
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        if (!cgroup_path_read)
+        {
+            cgroup_path = default_cgroup_path();
+            cgroup_path_read = true;
+        }
+        return cgroup_path;
+    }
+
+    bool read_cgroup_memory(CgroupMemory& memory)
+    {
+        const std::string dirpath = get_cgroup_path();
+        if (!read_cgroup_file(dirpath + "/memory.max", memory.max)
+                || !read_cgroup_file(dirpath + "/memory.current",
+                    memory.current))
+            return false;
+        /* memory.high doesn't exist in the root cgroup */
+        if (!read_cgroup_file(dirpath + "/memory.high", memory.high))
+            memory.high = no_cgroup_limit;
+        return true;
+    }
+
+    void set_domain_budget(const char* domain_name, double share,
+            double hard_share)
+    {
+        const size_t limit = read_limit();
+        std::lock_guard<std::mutex> locker(state_mutex);
+        bool found = false;
+        for (Budget& budget : budgets)
+        {
+            if (budget.domain == domain_name)
+            {
+                budget.share = share;
+                budget.hard_share = hard_share;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            Budget budget = { domain_name, share, hard_share };
+            budgets.push_back(budget);
+        }
+        apply_budgets(limit);
+    }
+
+    size_t get_domain_budget(const char* domain_name)
+    {
+        double share = 0;
+        {
+            std::lock_guard<std::mutex> locker(state_mutex);
+            for (const Budget& budget : budgets)
+            {
+                if (budget.domain == domain_name)
+                    share = budget.share;
+            }
+        }
+        return share == 0 ? 0 : share_of(read_limit(), share);
+    }
+
+    bool over_budget(const char* domain_name)
+    {
+        size_t budget = get_domain_budget(domain_name);
+        BaseDomain *dom = AllDomains::getInstance().find(domain_name);
+        return budget != 0 && dom != nullptr && dom->get_size() > budget;
+    }
+
+    void set_pool_cache_share(double share)
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        pool_cache_share = share;
+    }
+
+    size_t get_pool_cache_limit()
+    {
+        double share;
+        {
+            std::lock_guard<std::mutex> locker(state_mutex);
+            share = pool_cache_share;
+        }
+        return share == 0 ? 0 : share_of(read_limit(), share);
+    }
+
+    void add_pressure_callback(PressureCallback callback)
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        callbacks.push_back(callback);
+    }
+
+    void remove_pressure_callback(PressureCallback callback)
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        callbacks.erase(std::remove(callbacks.begin(), callbacks.end(),
+                    callback), callbacks.end());
+    }
+
+    void set_pressure_threshold(double usage)
+    {
+        std::lock_guard<std::mutex> locker(state_mutex);
+        pressure_threshold = usage;
+    }
+
+    void notify_memory_pressure()
+    {
+        MemoryPressure pressure;
+        if (!read_cgroup_memory(pressure.memory))
+        {
+            pressure.memory.max = no_cgroup_limit;
+            pressure.memory.high = no_cgroup_limit;
+            pressure.memory.current = 0;
+        }
+        const size_t limit = pressure.memory.limit();
+        pressure.usage = limit == no_cgroup_limit || limit == 0 ? 1
+            : static_cast<double>(pressure.memory.current)
+                / static_cast<double>(limit);
+
+        std::vector<PressureCallback> to_call;
+        {
+            std::lock_guard<std::mutex> locker(state_mutex);
+            to_call = callbacks;
+        }
+        pressure.trimmed = SlabPool::trim_all();
+        for (PressureCallback callback : to_call)
+            callback(pressure);
+    }
+
+    bool check_memory_pressure()
+    {
+        if (pressure_requested.exchange(false, std::memory_order_acquire))
+        {
+            notify_memory_pressure();
+            return true;
+        }
+
+        MemoryPressure pressure;
+        if (!read_cgroup_memory(pressure.memory))
+            return false;
+        const size_t limit = pressure.memory.limit();
+        {
+            std::lock_guard<std::mutex> locker(state_mutex);
+            apply_budgets(limit);
+        }
+        if (limit == no_cgroup_limit || limit == 0)
+            return false;
+        pressure.usage = static_cast<double>(pressure.memory.current)
+            / static_cast<double>(limit);
+
+        double threshold;
+        double cache_share;
+        std::vector<PressureCallback> to_call;
+        {
+            std::lock_guard<std::mutex> locker(state_mutex);
+            threshold = pressure_threshold;
+            cache_share = pool_cache_share;
+            to_call = callbacks;
+        }
+
+        const size_t cache_limit = share_of(limit, cache_share);
+        const bool under_pressure = pressure.usage >= threshold;
+        pressure.trimmed = 0;
+        /* the reserved chunks were asked for, only the pressure takes them */
+        if (under_pressure)
+            pressure.trimmed = SlabPool::trim_all();
+        else if (cache_limit != 0
+                && SlabPool::get_total_chunks_size() > cache_limit)
+            pressure.trimmed = SlabPool::trim_total(cache_limit, true);
+
+        if (under_pressure)
+        {
+            for (PressureCallback callback : to_call)
+                callback(pressure);
+        }
+        return under_pressure;
+    }
+
+    void request_memory_pressure() noexcept
+    {
+        pressure_requested.store(true, std::memory_order_release);
+        pressure_thread.wake();
+    }
+
+    bool start_pressure_thread(std::chrono::milliseconds period)
+    {
+        return pressure_thread.start(period, pressure_task);
+    }
+
+    void stop_pressure_thread()
+    {
+        pressure_thread.stop();
+    }
+}} // namespace nq::memlib
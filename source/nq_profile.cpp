@@ -0,0 +1,101 @@
+#include "../include/nq_memlib/nq_profile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    std::string& exit_filepath()
+    {
+        static std::string filepath;
+        return filepath;
+    }
+
+    void save_at_exit()
+    {
+        nq::memlib::save_profile(exit_filepath());
+    }
+} // namespace
+
+namespace nq { namespace memlib {
+    Profile current_profile()
+    {
+        Profile profile;
+        AllDomains::getInstance().for_each([&profile](BaseDomain& dom)
+        {
+            for (size_t index = 0; index < BaseDomain::profile_classes;
+                    ++index)
+            {
+                size_t peak = dom.get_class_peak(index);
+                if (peak == 0)
+                    continue;
+                ProfileEntry entry = { dom.name(),
+                    index == SlabPool::nb_classes
+                        ? 0 : SlabPool::class_size(index),
+                    peak };
+                profile.push_back(entry);
+            }
+        });
+        return profile;
+    }
+
+    bool save_profile(const std::string& filepath)
+    {
+        Profile profile = current_profile();
+        std::ofstream file(filepath.c_str());
+        if (!file)
+            return false;
+        for (const ProfileEntry& entry : profile)
+            file << entry.domain << " " << entry.class_size << " "
+                << entry.peak << "\n";
+        return static_cast<bool>(file);
+    }
+
+    bool load_profile(const std::string& filepath, Profile& profile)
+    {
+        std::ifstream file(filepath.c_str());
+        if (!file)
+            return false;
+        ProfileEntry entry;
+        while (file >> entry.domain >> entry.class_size >> entry.peak)
+            profile.push_back(entry);
+        return file.eof();
+    }
+
+    void save_profile_at_exit(const std::string& filepath)
+    {
+        static bool registered = false;
+        exit_filepath() = filepath;
+        if (!registered)
+            registered = std::atexit(save_at_exit) == 0;
+    }
+
+    size_t profile_size(const Profile& profile, const char* domain_name,
+            size_t headers, size_t chunk_size)
+    {
+        size_t size = 0;
+        for (const ProfileEntry& entry : profile)
+        {
+            if (entry.domain != domain_name || entry.peak == 0)
+                continue;
+            size_t index = SlabPool::nb_classes;
+            if (entry.class_size != 0)
+                index = SlabPool::class_of(entry.class_size + headers, 1);
+            size_t chunks;
+            if (index == SlabPool::nb_classes)
+            {
+                size_t bytes = entry.class_size == 0 ? entry.peak
+                    : entry.peak * (entry.class_size + headers);
+                chunks = (bytes + chunk_size - 1) / chunk_size;
+            }
+            else
+            {
+                size_t blocks = SlabPool::slab_blocks(index, chunk_size);
+                chunks = (entry.peak + blocks - 1) / blocks;
+            }
+            size += chunks * chunk_size;
+        }
+        return size;
+    }
+}} // namespace nq::memlib
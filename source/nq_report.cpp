@@ -0,0 +1,331 @@
+#include "../include/nq_memlib/nq_report.h"
+#include "../include/nq_memlib/lib_domains.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef NQ_WIN_
+# include <fcntl.h>
+# include <io.h>
+#else // NQ_WIN_
+# include <fcntl.h>
+# include <unistd.h>
+#endif // !NQ_WIN_
+
+namespace nq { namespace log {
+    /* forward declaration of the function defined in nq_log_printer.cpp*/
+    void print_helper(std::ostream& os, const char* message);
+
+namespace {
+# ifdef WITH_NQ_MEMLOG
+    /* Call sites are keyed on the content of the file name, the same file
+     * can be logged from different translation units */
+    struct CallSiteLess
+    {
+        bool operator()(const std::pair<const char*, size_t>& lhs,
+                const std::pair<const char*, size_t>& rhs) const
+        {
+            int cmp = std::strcmp(lhs.first, rhs.first);
+            return cmp < 0 || (cmp == 0 && lhs.second < rhs.second);
+        }
+    };
+
+    /* number of Domains listed by print_top_contended */
+    const size_t top_contended = 5;
+
+    typedef std::map<std::pair<const char*, size_t>,
+            std::pair<size_t, size_t>, CallSiteLess> CallSites;
+
+    void print_latency(std::ostream& os, const std::string& tabs,
+            const char* name, const nq::memlib::LatencySnapshot& latency)
+    {
+        if (latency.count == 0)
+            return;
+        os << tabs << "\t" << name << " latency (ns): p50: " << latency.p50
+            << ", p99: " << latency.p99 << ", p999: " << latency.p999
+            << ", calls: " << latency.count << "\n";
+    }
+
+    void print_snapshot(std::ostream& os, const DomainSnapshot& snap)
+    {
+        std::string tabs(snap.depth, '\t');
+
+        os << tabs << snap.name << ": nb_alloc: " << snap.count
+            << ", size_alloc: " << snap.size;
+        if (snap.huge_size != 0)
+            os << ", huge_pages: " << snap.huge_size;
+        if (snap.faulted_size != 0 || snap.reserved_size != 0)
+            os << ", prefaulted: " << snap.faulted_size
+                << ", reserved: " << snap.reserved_size;
+        if (snap.truncated)
+            os << " (call sites truncated)";
+        os << "\n";
+
+        bool first = true;
+        for (size_t index = 0; index < nq::memlib::tracked_threads; ++index)
+        {
+            if (snap.thread_live[index] == 0)
+                continue;
+            os << (first ? tabs + "\tlive per thread:" : std::string(","))
+                << " " << index << ": " << snap.thread_live[index];
+            first = false;
+        }
+        if (!first)
+            os << "\n";
+        first = true;
+        for (size_t alloc = 0; alloc < nq::memlib::tracked_threads; ++alloc)
+        {
+            for (size_t index = 0; index < nq::memlib::tracked_threads;
+                    ++index)
+            {
+                if (index == alloc || snap.thread_frees[alloc][index] == 0)
+                    continue;
+                os << (first ? tabs + "\tremote frees:" : std::string(","))
+                    << " " << alloc << "->" << index << ": "
+                    << snap.thread_frees[alloc][index];
+                first = false;
+            }
+        }
+        if (!first)
+            os << "\n";
+        if (snap.lock_contended != 0)
+            os << tabs << "\tmutex contended: " << snap.lock_contended
+                << ", uncontended: " << snap.lock_uncontended
+                << ", waited: " << snap.lock_wait_ns << " ns\n";
+        print_latency(os, tabs, "strategy", snap.strategy_latency);
+        print_latency(os, tabs, "domain", snap.domain_latency);
+        for (size_t id = 1; id < nq::memlib::tracked_types; ++id)
+        {
+            if (snap.type_count[id] == 0)
+                continue;
+            os << tabs << "\ttype " << nq::memlib::type_name(id)
+                << ": nb_alloc: " << snap.type_count[id]
+                << ", size_alloc: " << snap.type_live[id] << "\n";
+        }
+
+        /* aggregate the headers per call site, out of any lock */
+        CallSites sites;
+        for (const CallSiteSnapshot& site : snap.sites)
+        {
+            std::pair<size_t, size_t>& infos =
+                sites[std::make_pair(site.file, site.line)];
+            infos.first++;
+            infos.second += site.size;
+        }
+        for (const CallSites::value_type& site : sites)
+        {
+            os << tabs << "\t@ File: " << site.first.first
+                << ", Line: " << site.first.second
+                << ", nb_alloc: " << site.second.first
+                << ", size_alloc: " << site.second.second << "\n";
+        }
+    }
+
+    /* the Domains whose mutex was the most contended, worst first */
+    void print_top_contended(std::ostream& os,
+            const std::vector<DomainSnapshot>& snaps)
+    {
+        std::vector<const DomainSnapshot*> contended;
+        for (const DomainSnapshot& snap : snaps)
+        {
+            if (snap.lock_contended != 0)
+                contended.push_back(&snap);
+        }
+        if (contended.empty())
+            return;
+        std::sort(contended.begin(), contended.end(),
+                [](const DomainSnapshot *lhs, const DomainSnapshot *rhs)
+                { return lhs->lock_wait_ns > rhs->lock_wait_ns; });
+        if (contended.size() > top_contended)
+            contended.resize(top_contended);
+
+        os << "top contended Domains:\n";
+        for (const DomainSnapshot *snap : contended)
+        {
+            const size_t total = snap->lock_contended
+                + snap->lock_uncontended;
+            os << "\t" << snap->name << ": waited: " << snap->lock_wait_ns
+                << " ns, contended: " << snap->lock_contended << "/"
+                << total << "\n";
+        }
+    }
+# endif // !WITH_NQ_MEMLOG
+
+    /*
+    ** State of the report thread.
+    ** The signal handler only knows about reporting_ and pipe_write_,
+    ** everything else is touched by start/stop under state_mutex_.
+    ** The pipe is opened by the first start and never closed: a handler
+    ** still running after stop_report_thread writes to a valid pipe, its
+    ** request is served by the next report thread.
+    */
+    std::mutex state_mutex_;
+
+    /* a joinable std::thread destroyed at exit would call terminate() */
+    struct ReportThread
+    {
+        std::thread thread;
+
+        ~ReportThread()
+        {
+            stop_report_thread();
+        }
+    } report_thread_;
+    int pipe_read_ = -1;
+    std::atomic<int> pipe_write_(-1);
+    std::atomic<bool> reporting_(false);
+# ifndef NQ_WIN_
+    int signum_ = 0;
+    struct sigaction old_action_;
+# endif // !NQ_WIN_
+
+    const char report_byte = 'r';
+    const char quit_byte = 'q';
+
+    /*
+    ** The write end doesn't block: when the pipe is full, reports are
+    ** already pending and the request is dropped
+    */
+    int pipe_open(int fds[2])
+    {
+# ifdef NQ_WIN_
+        return _pipe(fds, 256, _O_BINARY);
+# else // NQ_WIN_
+        if (pipe(fds) != 0)
+            return -1;
+        if (fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK) != 0)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        return 0;
+# endif // !NQ_WIN_
+    }
+
+    int pipe_write(int fd, char c)
+    {
+# ifdef NQ_WIN_
+        return _write(fd, &c, 1);
+# else // NQ_WIN_
+        return write(fd, &c, 1);
+# endif // !NQ_WIN_
+    }
+
+    int pipe_read(int fd, char *c)
+    {
+# ifdef NQ_WIN_
+        return _read(fd, c, 1);
+# else // NQ_WIN_
+        return read(fd, c, 1);
+# endif // !NQ_WIN_
+    }
+
+    void report_loop(std::string filepath, int fd)
+    {
+        char c = 0;
+        for (;;)
+        {
+            int res = pipe_read(fd, &c);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0 || c == quit_byte)
+                break;
+            std::ofstream file(filepath, std::ios_base::app);
+            report(file, "report requested");
+        }
+    }
+
+# ifndef NQ_WIN_
+    void report_signal_handler(int)
+    {
+        /* write() is async-signal-safe, errno must be kept as it was */
+        int saved_errno = errno;
+        request_report();
+        errno = saved_errno;
+    }
+# endif // !NQ_WIN_
+} // namespace
+
+    void report(std::ostream& os, const char* message)
+    {
+        std::vector<DomainSnapshot> snaps;
+        AllDomains::getInstance().snapshot(snaps);
+
+        os << "==================\n";
+        print_helper(os, message);
+# ifdef WITH_NQ_MEMLOG
+        for (const DomainSnapshot& snap : snaps)
+            print_snapshot(os, snap);
+        print_top_contended(os, snaps);
+# else // WITH_NQ_MEMLOG
+        os << "memlib compiled without WITH_NQ_MEMLOG, nothing logged\n";
+# endif // !WITH_NQ_MEMLOG
+        os << "==================" << std::endl;
+    }
+
+# ifndef NQ_WIN_
+    bool start_report_thread(const std::string& filepath, int signum)
+# else // !NQ_WIN_
+    bool start_report_thread(const std::string& filepath)
+# endif // NQ_WIN_
+    {
+        std::lock_guard<std::mutex> locker(state_mutex_);
+        if (report_thread_.thread.joinable())
+            return false;
+
+        if (pipe_read_ == -1)
+        {
+            int fds[2];
+            if (pipe_open(fds) != 0)
+                return false;
+            pipe_read_ = fds[0];
+            pipe_write_.store(fds[1]);
+        }
+        reporting_.store(true);
+
+        report_thread_.thread = std::thread(report_loop, filepath,
+                pipe_read_);
+
+# ifndef NQ_WIN_
+        struct sigaction action;
+        std::memset(&action, 0, sizeof (action));
+        action.sa_handler = report_signal_handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        signum_ = signum;
+        sigaction(signum_, &action, &old_action_);
+# endif // !NQ_WIN_
+        return true;
+    }
+
+    void stop_report_thread()
+    {
+        std::lock_guard<std::mutex> locker(state_mutex_);
+        if (!report_thread_.thread.joinable())
+            return;
+
+# ifndef NQ_WIN_
+        sigaction(signum_, &old_action_, nullptr);
+# endif // !NQ_WIN_
+
+        /* the requests written before the quit byte are served */
+        reporting_.store(false);
+        while (pipe_write(pipe_write_.load(), quit_byte) != 1)
+            std::this_thread::yield();
+        report_thread_.thread.join();
+    }
+
+    void request_report()
+    {
+        if (reporting_.load())
+            pipe_write(pipe_write_.load(), report_byte);
+    }
+}} // namespace nq::log
@@ -0,0 +1,169 @@
+#include "../include/nq_memlib/numa_alloc.h"
+#include "../include/nq_memlib/env_maccro.h"
+
+#include <cstdio>
+#include <new>
+#include <type_traits>
+
+#ifdef __linux__
+# include <sched.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif // !__linux__
+
+namespace
+{
+    /*
+    ** /sys/devices/system/node/online lists the node ranges ("0-3" or
+    ** "0,2-3"): the count is the biggest node + 1
+    */
+    int read_node_count()
+    {
+#ifdef __linux__
+        std::FILE *file = std::fopen("/sys/devices/system/node/online", "r");
+        if (file == nullptr)
+            return 1;
+        int last = 0;
+        int node = 0;
+        char separator = 0;
+        while (std::fscanf(file, "%d%c", &node, &separator) >= 1)
+        {
+            if (node > last)
+                last = node;
+            if (separator == '\n')
+                break;
+            separator = 0;
+        }
+        std::fclose(file);
+        return last + 1;
+#else // __linux__
+        return 1;
+#endif // !__linux__
+    }
+
+    /* the cpus beyond max_cpus ask the kernel for their node every time */
+    const int max_cpus = 1024;
+    const unsigned char unknown_node = 0xff;
+
+    /*
+    ** node of each cpu, from /sys/devices/system/node/node<N>/cpulist
+    ** ("0-3,8-11"), unknown_node when not listed
+    */
+    const unsigned char* read_cpu_nodes(int count)
+    {
+        static unsigned char nodes[max_cpus];
+        for (int cpu = 0; cpu < max_cpus; ++cpu)
+            nodes[cpu] = unknown_node;
+#ifdef __linux__
+        for (int node = 0; node < count && node < unknown_node; ++node)
+        {
+            char path[64];
+            std::snprintf(path, sizeof (path),
+                    "/sys/devices/system/node/node%d/cpulist", node);
+            std::FILE *file = std::fopen(path, "r");
+            if (file == nullptr)
+                continue;
+            int first = 0;
+            int last = 0;
+            char separator = 0;
+            while (std::fscanf(file, "%d%c", &first, &separator) >= 1)
+            {
+                last = first;
+                if (separator == '-'
+                        && std::fscanf(file, "%d%c", &last, &separator) < 1)
+                    break;
+                for (int cpu = first; cpu <= last && cpu < max_cpus; ++cpu)
+                    if (cpu >= 0)
+                        nodes[cpu] = static_cast<unsigned char>(node);
+                if (separator != ',')
+                    break;
+                separator = 0;
+            }
+            std::fclose(file);
+        }
+#else // __linux__
+        (void)count;
+#endif // !__linux__
+        return nodes;
+    }
+
+    nq::memlib::SlabPool* create_pools(int count)
+    {
+        /* never destroyed: static objects may still free in them at exit */
+        static std::aligned_storage<sizeof (nq::memlib::SlabPool),
+               alignof(nq::memlib::SlabPool)>::type
+                   storage[nq::memlib::max_numa_nodes];
+
+        nq::memlib::SlabPool *pools =
+            reinterpret_cast<nq::memlib::SlabPool*>(storage);
+        for (int node = 0; node < count; ++node)
+            new (&storage[node]) nq::memlib::SlabPool(
+                    &nq::memlib::PageSource::allocate_chunk,
+                    &nq::memlib::PageSource::deallocate_chunk,
+                    nq::memlib::PageSource::chunk_size,
+                    count == 1 ? -1 : node);
+        return pools;
+    }
+} // namespace
+
+namespace nq { namespace memlib
+{
+    int numa_node_count()
+    {
+        static const int count = read_node_count();
+        return count;
+    }
+
+    /*
+    ** Called on every allocation of NumaAlloc: sched_getcpu goes through
+    ** the vDSO (no syscall), its node is then read in a table built once
+    */
+    int current_numa_node()
+    {
+        if (numa_node_count() == 1)
+            return 0;
+#ifdef __linux__
+        static const unsigned char *cpu_nodes =
+            read_cpu_nodes(numa_node_count());
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < max_cpus && cpu_nodes[cpu] != unknown_node)
+            return cpu_nodes[cpu];
+# ifdef SYS_getcpu
+        unsigned any_cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &any_cpu, &node, nullptr) == 0)
+            return static_cast<int>(node);
+# endif // !SYS_getcpu
+#endif // !__linux__
+        return 0;
+    }
+
+    SlabPool& numa_pool(int node)
+    {
+        static const int count = numa_node_count() < max_numa_nodes
+            ? numa_node_count() : static_cast<int>(max_numa_nodes);
+        static SlabPool *pools = create_pools(count);
+
+        if (node < 0)
+            node = current_numa_node();
+        return pools[node % count];
+    }
+
+    void set_numa_pool_options(unsigned options)
+    {
+        const int count = numa_node_count() < max_numa_nodes
+            ? numa_node_count() : static_cast<int>(max_numa_nodes);
+        for (int node = 0; node < count; ++node)
+            numa_pool(node).set_options(options);
+    }
+
+    std::size_t trim_numa_pools(std::size_t target)
+    {
+        const int count = numa_node_count() < max_numa_nodes
+            ? numa_node_count() : static_cast<int>(max_numa_nodes);
+        std::size_t trimmed = 0;
+        for (int node = 0; node < count; ++node)
+            trimmed += numa_pool(node).trim(target / count);
+        return trimmed;
+    }
+}} // namespace nq::memlib
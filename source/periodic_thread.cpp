@@ -0,0 +1,44 @@
+#include "../include/nq_memlib/periodic_thread.h"
+
+namespace nq { namespace memlib
+{
+    bool PeriodicThread::start(std::chrono::milliseconds period, Task task)
+    {
+        std::lock_guard<std::mutex> locker(state_);
+        if (thread_.joinable())
+            return false;
+        stop_ = false;
+        thread_ = std::thread(&PeriodicThread::loop, this, period, task);
+        return true;
+    }
+
+    void PeriodicThread::stop()
+    {
+        std::lock_guard<std::mutex> locker(state_);
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> stop_locker(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void PeriodicThread::loop(std::chrono::milliseconds period, Task task)
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        auto woken = [this]()
+        { return stop_ || woken_.load(std::memory_order_acquire); };
+        for (;;)
+        {
+            wake_.wait_for(locker, period, woken);
+            if (stop_)
+                break;
+            woken_.store(false, std::memory_order_relaxed);
+            locker.unlock();
+            task();
+            locker.lock();
+        }
+    }
+}} // namespace nq::memlib
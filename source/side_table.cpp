@@ -0,0 +1,224 @@
+#include "../include/nq_memlib/side_table.h"
+#include "../include/nq_memlib/base_domain.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <type_traits>
+
+#ifdef WITH_NQ_MEMLOG
+namespace
+{
+    struct Node
+    {
+        /* first member, so the Header pointer is the Node one */
+        std::aligned_storage<BaseDomain::sub_header_size,
+            alignof(std::max_align_t)>::type header_;
+        const void *usr_ptr_;
+        Node *next_;
+    };
+
+    /*
+    ** Each stripe is a chained hash table with its own lock, growing its
+    ** buckets when it holds more Nodes than buckets. Until the first growth
+    ** (or if it never succeeds) its Nodes are chained in first_.
+    ** Everything is allocated with malloc: the side table is called by the
+    ** memlib allocations and can't come back in them.
+    */
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex_;
+        Node *first_ = nullptr;
+        Node **buckets_ = nullptr;
+        std::size_t nb_buckets_ = 0;
+        std::size_t count_ = 0;
+    };
+
+    const std::size_t nb_stripes = 64;
+    const std::size_t min_buckets = 16;
+
+    /* constant initialized, usable before any static constructor */
+    Stripe stripes[nb_stripes];
+
+    std::size_t hash(const void *ptr)
+    {
+        std::uint64_t key = reinterpret_cast<std::uintptr_t>(ptr);
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<std::size_t>(key);
+    }
+
+    Stripe& stripe_of(std::size_t key)
+    {
+        return stripes[key % nb_stripes];
+    }
+
+    Node** bucket_of(Stripe& stripe, std::size_t key)
+    {
+        if (stripe.buckets_ == nullptr)
+            return &stripe.first_;
+        return &stripe.buckets_[(key / nb_stripes) & (stripe.nb_buckets_ - 1)];
+    }
+
+    /* double the buckets of stripe, keep the old ones if out of memory */
+    void grow(Stripe& stripe)
+    {
+        std::size_t nb_buckets = stripe.nb_buckets_
+            ? stripe.nb_buckets_ * 2 : min_buckets;
+        Node **buckets = static_cast<Node**>(
+                std::calloc(nb_buckets, sizeof (Node*)));
+        if (buckets == nullptr)
+            return;
+
+        Node **old_buckets = stripe.buckets_;
+        std::size_t old_nb_buckets = stripe.nb_buckets_;
+        if (old_buckets == nullptr)
+        {
+            old_buckets = &stripe.first_;
+            old_nb_buckets = 1;
+        }
+        stripe.buckets_ = buckets;
+        stripe.nb_buckets_ = nb_buckets;
+        for (std::size_t i = 0; i < old_nb_buckets; ++i)
+        {
+            Node *node = old_buckets[i];
+            while (node != nullptr)
+            {
+                Node *next = node->next_;
+                Node **bucket = bucket_of(stripe, hash(node->usr_ptr_));
+                node->next_ = *bucket;
+                *bucket = node;
+                node = next;
+            }
+        }
+        stripe.first_ = nullptr;
+        if (old_buckets != &stripe.first_)
+            std::free(old_buckets);
+    }
+} // namespace
+
+namespace nq { namespace memlib
+{
+    void* side_table_insert(const void *usr_ptr)
+    {
+        Node *node = static_cast<Node*>(std::malloc(sizeof (Node)));
+        if (node == nullptr)
+            return nullptr;
+        node->usr_ptr_ = usr_ptr;
+
+        std::size_t key = hash(usr_ptr);
+        Stripe& stripe = stripe_of(key);
+        std::lock_guard<std::mutex> locker(stripe.mutex_);
+
+        if (stripe.count_ >= stripe.nb_buckets_)
+            grow(stripe);
+        Node **bucket = bucket_of(stripe, key);
+        node->next_ = *bucket;
+        *bucket = node;
+        ++stripe.count_;
+        return &node->header_;
+    }
+
+    void* side_table_take(const void *usr_ptr)
+    {
+        std::size_t key = hash(usr_ptr);
+        Stripe& stripe = stripe_of(key);
+        std::lock_guard<std::mutex> locker(stripe.mutex_);
+
+        for (Node **it = bucket_of(stripe, key); *it != nullptr;
+                it = &(*it)->next_)
+        {
+            if ((*it)->usr_ptr_ == usr_ptr)
+            {
+                Node *node = *it;
+                *it = node->next_;
+                --stripe.count_;
+                return &node->header_;
+            }
+        }
+        /*
+        ** The caller would untrack a Header that doesn't exist: a double
+        ** free, or a pointer of another allocator. Stop in every build.
+        */
+        std::fputs("nq_memlib: pointer not found in the side table\n",
+                stderr);
+        std::abort();
+    }
+
+    void side_table_release(void *header)
+    {
+        std::free(header);
+    }
+
+    void* side_table_find(const void *usr_ptr)
+    {
+        std::size_t key = hash(usr_ptr);
+        Stripe& stripe = stripe_of(key);
+        std::lock_guard<std::mutex> locker(stripe.mutex_);
+
+        for (Node *it = *bucket_of(stripe, key); it != nullptr;
+                it = it->next_)
+        {
+            if (it->usr_ptr_ == usr_ptr)
+                return &it->header_;
+        }
+        return nullptr;
+    }
+
+    void side_table_move(void *header, const void *old_usr_ptr,
+            const void *new_usr_ptr)
+    {
+        /*
+        ** Once old_usr_ptr is released, another allocation may be keyed
+        ** under it too: the Node is found by its Header.
+        */
+        Node *node = static_cast<Node*>(header);
+        {
+            std::size_t key = hash(old_usr_ptr);
+            Stripe& stripe = stripe_of(key);
+            std::lock_guard<std::mutex> locker(stripe.mutex_);
+
+            Node **it = bucket_of(stripe, key);
+            while (*it != node)
+                it = &(*it)->next_;
+            *it = node->next_;
+            --stripe.count_;
+        }
+
+        std::size_t key = hash(new_usr_ptr);
+        Stripe& stripe = stripe_of(key);
+        std::lock_guard<std::mutex> locker(stripe.mutex_);
+
+        if (stripe.count_ >= stripe.nb_buckets_)
+            grow(stripe);
+        node->usr_ptr_ = new_usr_ptr;
+        Node **bucket = bucket_of(stripe, key);
+        node->next_ = *bucket;
+        *bucket = node;
+        ++stripe.count_;
+    }
+
+    std::size_t side_table_size()
+    {
+        std::size_t size = 0;
+        for (Stripe& stripe : stripes)
+        {
+            std::lock_guard<std::mutex> locker(stripe.mutex_);
+            size += stripe.count_;
+        }
+        return size;
+    }
+}} // namespace nq::memlib
+
+#else // WITH_NQ_MEMLOG
+namespace nq { namespace memlib
+{
+    /* there is no Header to keep aside without WITH_NQ_MEMLOG */
+    std::size_t side_table_size()
+    {
+        return 0;
+    }
+}} // namespace nq::memlib
+#endif // !WITH_NQ_MEMLOG
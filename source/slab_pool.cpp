@@ -0,0 +1,469 @@
+#include "../include/nq_memlib/pool_alloc.h"
+#include "../include/nq_memlib/periodic_thread.h"
+
+#include <cstdint>
+
+namespace nq { namespace memlib
+{
+    /*
+    ** class_ is nb_classes for the runs of chunks of the big allocations,
+    ** their user memory starts at offset_ in the first chunk
+    */
+    struct SlabPool::ChunkHeader
+    {
+        SlabPool *pool_; // the pool the chunk is given back to
+        std::size_t class_;
+        std::size_t size_; // size of the chunk (or the run of chunks)
+        std::size_t offset_;
+        /* next reserved, trimmed or partial (with freed blocks) chunk */
+        ChunkHeader *next_;
+        std::size_t live_; // blocks allocated, under the class mutex
+        void *free_; // freed blocks of the slab, chained by their 1st word
+        bool huge_;
+        bool advised_; // transparent huge pages asked
+        bool prefaulted_;
+        bool locked_;
+        bool idle_; // no live block at the last decay trim
+    };
+
+    namespace
+    {
+        constexpr std::size_t chunk_header_size = 64;
+        /* the classes are never aligned on more than a page */
+        const std::size_t max_class_alignment = 4096;
+
+        std::size_t align_up(std::size_t size, std::size_t align)
+        {
+            return (size + align - 1) & ~(align - 1);
+        }
+
+        /* the SlabPools alive, constant initialized */
+        std::mutex pools_mutex;
+        SlabPool *pools = nullptr;
+
+        PeriodicThread decay_thread;
+        std::atomic<std::size_t> decayed_size(0);
+
+        void decay_task()
+        {
+            decayed_size.fetch_add(SlabPool::trim_all(true),
+                    std::memory_order_relaxed);
+        }
+    } // namespace
+
+    SlabPool::SlabPool(ChunkAlloc chunk_alloc, ChunkDealloc chunk_dealloc,
+            std::size_t chunk_size, int node)
+        : chunk_alloc_(chunk_alloc),
+        chunk_dealloc_(chunk_dealloc),
+        chunk_size_(chunk_size),
+        node_(node),
+        chunks_size_(0),
+        huge_chunks_size_(0),
+        advised_chunks_size_(0),
+        options_(0),
+        reserved_size_(0),
+        faulted_size_(0),
+        locked_size_(0),
+        trimmed_size_(0),
+        prev_pool_(nullptr)
+    {
+        static_assert(sizeof (ChunkHeader) <= chunk_header_size,
+                "The ChunkHeader must fit before the first block of a slab");
+
+        std::lock_guard<std::mutex> locker(pools_mutex);
+        next_pool_ = pools;
+        if (pools != nullptr)
+            pools->prev_pool_ = this;
+        pools = this;
+    }
+
+    SlabPool::~SlabPool()
+    {
+        std::lock_guard<std::mutex> locker(pools_mutex);
+        if (prev_pool_ != nullptr)
+            prev_pool_->next_pool_ = next_pool_;
+        else
+            pools = next_pool_;
+        if (next_pool_ != nullptr)
+            next_pool_->prev_pool_ = prev_pool_;
+    }
+
+    /* 16 to 128 by 16, then 4 classes per power of 2 up to 32 KiB */
+    std::size_t SlabPool::class_size(std::size_t index)
+    {
+        if (index < 8)
+            return 16 * (index + 1);
+        std::size_t power = std::size_t(128) << ((index - 8) / 4);
+        return power + power / 4 * ((index - 8) % 4 + 1);
+    }
+
+    std::size_t SlabPool::class_alignment(std::size_t index)
+    {
+        std::size_t size = class_size(index);
+        std::size_t align = size & (~size + 1);
+        return align < max_class_alignment ? align : max_class_alignment;
+    }
+
+    std::size_t SlabPool::slab_blocks(std::size_t index,
+            std::size_t chunk_size)
+    {
+        std::size_t offset = align_up(chunk_header_size,
+                class_alignment(index));
+        return (chunk_size - offset) / class_size(index);
+    }
+
+    std::size_t SlabPool::class_of(std::size_t size, std::size_t align)
+    {
+        if (size > max_class_size)
+            return nb_classes;
+
+        std::size_t index;
+        if (size <= 128)
+            index = size == 0 ? 0 : (size + 15) / 16 - 1;
+        else
+        {
+            std::size_t last = size - 1;
+            std::size_t msb = 0;
+            while ((last >> (msb + 1)) != 0)
+                ++msb;
+            std::size_t power = std::size_t(1) << msb;
+            index = 8 + (msb - 7) * 4 + (last - power) / (power / 4);
+        }
+        while (index < nb_classes && class_alignment(index) < align)
+            ++index;
+        return index;
+    }
+
+    /* a chunk from the ChunkSource, faulted in and locked per options_ */
+    SlabPool::ChunkHeader* SlabPool::take_chunk(std::size_t size)
+    {
+        ChunkPages pages = regular_pages;
+        void *chunk = chunk_alloc_(size, node_, pages);
+        if (chunk == nullptr)
+            return nullptr;
+
+        const unsigned options = get_options();
+        bool locked = (options & lock_pages) != 0 && lock_chunk(chunk, size);
+        bool prefaulted = locked || (options & (prefault | lock_pages)) != 0;
+        if (prefaulted && !locked)
+            prefault_chunk(chunk, size);
+
+        chunks_size_.fetch_add(size, std::memory_order_relaxed);
+        if (pages == huge_pages)
+            huge_chunks_size_.fetch_add(size, std::memory_order_relaxed);
+        if (pages == advised_pages)
+            advised_chunks_size_.fetch_add(size, std::memory_order_relaxed);
+        if (prefaulted)
+            faulted_size_.fetch_add(size, std::memory_order_relaxed);
+        if (locked)
+            locked_size_.fetch_add(size, std::memory_order_relaxed);
+        ChunkHeader *header = new (chunk) ChunkHeader;
+        header->pool_ = this;
+        header->size_ = size;
+        header->next_ = nullptr;
+        header->huge_ = pages == huge_pages;
+        header->advised_ = pages == advised_pages;
+        header->prefaulted_ = prefaulted;
+        header->locked_ = locked;
+        return header;
+    }
+
+    SlabPool::ChunkHeader* SlabPool::new_chunk(std::size_t size,
+            std::size_t index, std::size_t offset)
+    {
+        ChunkHeader *header = nullptr;
+        if (size == chunk_size_
+                && reserved_size_.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> locker(spare_mutex_);
+            header = spare_;
+            if (header != nullptr)
+            {
+                spare_ = header->next_;
+                header->next_ = nullptr;
+                reserved_size_.fetch_sub(size, std::memory_order_relaxed);
+            }
+        }
+        if (header == nullptr)
+            header = take_chunk(size);
+        if (header == nullptr)
+            return nullptr;
+
+        header->class_ = index;
+        header->offset_ = offset;
+        header->live_ = 0;
+        header->free_ = nullptr;
+        header->idle_ = false;
+        return header;
+    }
+
+    /* give a chunk back to the ChunkSource */
+    void SlabPool::free_chunk(ChunkHeader *header)
+    {
+        std::size_t size = header->size_;
+        chunks_size_.fetch_sub(size, std::memory_order_relaxed);
+        if (header->huge_)
+            huge_chunks_size_.fetch_sub(size, std::memory_order_relaxed);
+        if (header->advised_)
+            advised_chunks_size_.fetch_sub(size, std::memory_order_relaxed);
+        if (header->prefaulted_)
+            faulted_size_.fetch_sub(size, std::memory_order_relaxed);
+        if (header->locked_)
+            locked_size_.fetch_sub(size, std::memory_order_relaxed);
+        chunk_dealloc_(header, size);
+    }
+
+    std::size_t SlabPool::reserve(std::size_t size)
+    {
+        std::size_t reserved = 0;
+        while (reserved < size)
+        {
+            ChunkHeader *header = take_chunk(chunk_size_);
+            if (header == nullptr)
+                break;
+            std::lock_guard<std::mutex> locker(spare_mutex_);
+            header->next_ = spare_;
+            spare_ = header;
+            reserved_size_.fetch_add(chunk_size_, std::memory_order_relaxed);
+            reserved += chunk_size_;
+        }
+        return reserved;
+    }
+
+    SlabPool::ChunkHeader* SlabPool::chunk_of(const void *ptr) const
+    {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+        return reinterpret_cast<ChunkHeader*>(
+                address & ~(static_cast<std::uintptr_t>(chunk_size_) - 1));
+    }
+
+    void* SlabPool::allocate(std::size_t size, std::size_t align)
+    {
+        std::size_t index = class_of(size, align);
+
+        /* the big allocations get their own run of chunks */
+        if (index == nb_classes)
+        {
+            std::size_t offset = align_up(chunk_header_size,
+                    align > chunk_header_size ? align : chunk_header_size);
+            /* align_up(offset + size) would wrap around */
+            if (offset >= chunk_size_
+                    || size > SIZE_MAX - offset - chunk_size_)
+                return nullptr;
+            ChunkHeader *header = new_chunk(
+                    align_up(offset + size, chunk_size_), nb_classes, offset);
+            if (header == nullptr)
+                return nullptr;
+            return reinterpret_cast<char*>(header) + offset;
+        }
+
+        SizeClass& size_class = classes_[index];
+        std::lock_guard<std::mutex> locker(size_class.mutex_);
+
+        if (size_class.partial_ != nullptr)
+        {
+            ChunkHeader *header = size_class.partial_;
+            void *ptr = header->free_;
+            header->free_ = *static_cast<void**>(ptr);
+            if (header->free_ == nullptr)
+            {
+                size_class.partial_ = header->next_;
+                header->next_ = nullptr;
+            }
+            ++header->live_;
+            header->idle_ = false;
+            return ptr;
+        }
+        if (size_class.bump_ == size_class.end_)
+        {
+            /* a new slab: the blocks follow the ChunkHeader */
+            std::size_t offset = align_up(chunk_header_size,
+                    class_alignment(index));
+            ChunkHeader *header = new_chunk(chunk_size_, index, offset);
+            if (header == nullptr)
+                return nullptr;
+            size_class.bump_ = reinterpret_cast<char*>(header) + offset;
+            size_class.end_ = size_class.bump_
+                + slab_blocks(index, chunk_size_) * class_size(index);
+        }
+        void *ptr = size_class.bump_;
+        size_class.bump_ += class_size(index);
+        ChunkHeader *header = chunk_of(ptr);
+        ++header->live_;
+        header->idle_ = false;
+        return ptr;
+    }
+
+    void SlabPool::deallocate(void *ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        ChunkHeader *header = chunk_of(ptr);
+        SlabPool& owner = *header->pool_;
+        if (header->class_ == nb_classes)
+        {
+            owner.free_chunk(header);
+            return;
+        }
+
+        SizeClass& size_class = owner.classes_[header->class_];
+        std::lock_guard<std::mutex> locker(size_class.mutex_);
+        --header->live_;
+        if (header->free_ == nullptr)
+        {
+            header->next_ = size_class.partial_;
+            size_class.partial_ = header;
+        }
+        *static_cast<void**>(ptr) = header->free_;
+        header->free_ = ptr;
+    }
+
+    bool SlabPool::huge_backed(const void *ptr) const
+    {
+        return ptr != nullptr && chunk_of(ptr)->huge_;
+    }
+
+    bool SlabPool::prefaulted(const void *ptr) const
+    {
+        return ptr != nullptr && chunk_of(ptr)->prefaulted_;
+    }
+
+    /*
+    ** Unlink from size_class the chunks without live block (their blocks are
+    ** all freed, so they are partial chunks) and return them chained by
+    ** next_. Only the partial chunks are walked, not their blocks. Called
+    ** under the class mutex.
+    */
+    SlabPool::ChunkHeader* SlabPool::collect_free_chunks(SizeClass& size_class,
+            std::size_t target, bool decay)
+    {
+        ChunkHeader *released = nullptr;
+        std::size_t size = get_chunks_size();
+        ChunkHeader **link = &size_class.partial_;
+        while (*link != nullptr)
+        {
+            ChunkHeader *chunk = *link;
+            if (chunk->live_ != 0)
+            {
+                link = &chunk->next_;
+                continue;
+            }
+            if ((decay && !chunk->idle_) || size <= target)
+            {
+                /* kept, the next decay trim gives it back if still idle */
+                chunk->idle_ = true;
+                link = &chunk->next_;
+                continue;
+            }
+            *link = chunk->next_;
+            size -= chunk->size_;
+            if (size_class.bump_ != nullptr
+                    && chunk_of(size_class.bump_ - 1) == chunk)
+            {
+                size_class.bump_ = nullptr;
+                size_class.end_ = nullptr;
+            }
+            chunk->next_ = released;
+            released = chunk;
+        }
+        return released;
+    }
+
+    std::size_t SlabPool::trim(std::size_t target, bool decay,
+            bool keep_reserved)
+    {
+        std::size_t trimmed = 0;
+        for (std::size_t index = 0; index < nb_classes; ++index)
+        {
+            if (get_chunks_size() <= target)
+                break;
+            ChunkHeader *released;
+            {
+                SizeClass& size_class = classes_[index];
+                std::lock_guard<std::mutex> locker(size_class.mutex_);
+                released = collect_free_chunks(size_class, target, decay);
+            }
+            while (released != nullptr)
+            {
+                ChunkHeader *next = released->next_;
+                trimmed += released->size_;
+                free_chunk(released);
+                released = next;
+            }
+        }
+
+        /* the reserved chunks were asked for, they go last */
+        while (!decay && !keep_reserved && get_chunks_size() > target)
+        {
+            ChunkHeader *spare;
+            {
+                std::lock_guard<std::mutex> locker(spare_mutex_);
+                spare = spare_;
+                if (spare == nullptr)
+                    break;
+                spare_ = spare->next_;
+                reserved_size_.fetch_sub(spare->size_,
+                        std::memory_order_relaxed);
+            }
+            trimmed += spare->size_;
+            free_chunk(spare);
+        }
+        trimmed_size_.fetch_add(trimmed, std::memory_order_relaxed);
+        return trimmed;
+    }
+
+    std::size_t SlabPool::trim_all(bool decay)
+    {
+        std::lock_guard<std::mutex> locker(pools_mutex);
+        std::size_t trimmed = 0;
+        for (SlabPool *pool = pools; pool != nullptr; pool = pool->next_pool_)
+            trimmed += pool->trim(0, decay);
+        return trimmed;
+    }
+
+    std::size_t SlabPool::trim_total(std::size_t target, bool keep_reserved)
+    {
+        std::lock_guard<std::mutex> locker(pools_mutex);
+        std::size_t total = 0;
+        for (SlabPool *pool = pools; pool != nullptr; pool = pool->next_pool_)
+            total += pool->get_chunks_size();
+        std::size_t trimmed = 0;
+        for (SlabPool *pool = pools; pool != nullptr && total > target;
+                pool = pool->next_pool_)
+        {
+            /* each pool gives back what the ones before it couldn't */
+            std::size_t excess = total - target;
+            std::size_t size = pool->get_chunks_size();
+            std::size_t given = pool->trim(size > excess ? size - excess : 0,
+                    false, keep_reserved);
+            trimmed += given;
+            total -= given < total ? given : total;
+        }
+        return trimmed;
+    }
+
+    std::size_t SlabPool::get_total_chunks_size()
+    {
+        std::lock_guard<std::mutex> locker(pools_mutex);
+        std::size_t size = 0;
+        for (SlabPool *pool = pools; pool != nullptr; pool = pool->next_pool_)
+            size += pool->get_chunks_size();
+        return size;
+    }
+
+    bool start_decay_thread(std::chrono::milliseconds period)
+    {
+        return decay_thread.start(period, decay_task);
+    }
+
+    void stop_decay_thread()
+    {
+        decay_thread.stop();
+    }
+
+    std::size_t get_decayed_size()
+    {
+        return decayed_size.load(std::memory_order_relaxed);
+    }
+}} // namespace nq::memlib
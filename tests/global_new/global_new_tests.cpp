@@ -0,0 +1,54 @@
+#include <string>
+#include <vector>
+
+#include <nq_memlib/current_domain.h>
+#include <nq_memlib/pool_alloc.h>
+
+#include "../source/test_check.h"
+#include "../source/test_domains.h"
+
+/*
+** The replaced global operator new needs an executable of its own, linked
+** with the whole nq_mem_global_new: every new of the process, those of the
+** std containers included, goes through the memlib.
+*/
+int main()
+{
+# ifdef WITH_NQ_MEMLOG
+    DomainEarth& earth = DomainEarth::getInstance();
+    UnknownDomain& unknown = UnknownDomain::getInstance();
+    const size_t earth_count = earth.get_count();
+    const size_t unknown_count = unknown.get_count();
+# endif // !WITH_NQ_MEMLOG
+    {
+        /* logged in the Domain of the scope */
+        nq::domain_scope<DomainEarth> scope;
+        int *value = new int(42);
+        std::string text(100, 'x');
+        std::vector<int> ints(1000);
+        TEST_CHECK(*value == 42 && text.size() == 100 && ints.size() == 1000);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(earth.get_count() == earth_count + 3);
+        TEST_CHECK(earth.get_size() >= 100 + 1001 * sizeof (int));
+# endif // !WITH_NQ_MEMLOG
+        delete value;
+    }
+
+    /* outside of any scope the news go to UnknownDomain */
+    /* volatile: an unused new and delete pair can be elided */
+    int *volatile orphan = new int[10];
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(earth.get_count() == earth_count);
+    TEST_CHECK(unknown.get_count() == unknown_count + 1);
+# endif // !WITH_NQ_MEMLOG
+    delete[] orphan;
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(unknown.get_count() == unknown_count);
+# endif // !WITH_NQ_MEMLOG
+
+# ifndef NQ_GLOBAL_NEW_MALLOC
+    /* the news are served by the pools of PoolAlloc */
+    TEST_CHECK(PoolAlloc<>::pool().get_chunks_size() != 0);
+# endif // !NQ_GLOBAL_NEW_MALLOC
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include "../source/test_check.h"
+
+/* the glibc allocator, its pointers are foreign to the shim */
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+}
+
+/*
+** Smoke test of libnq_memlib_preload.so: the test runs itself again with
+** the shim in LD_PRELOAD, then allocates through every entry point.
+*/
+int main(int, char** argv)
+{
+    if (std::getenv("NQ_PRELOAD_TESTED") == nullptr)
+    {
+        setenv("NQ_PRELOAD_TESTED", "1", 1);
+        setenv("LD_PRELOAD", NQ_PRELOAD_PATH, 1);
+        execv("/proc/self/exe", argv);
+        return 1;
+    }
+
+    /* the usable size of the shim is the size asked, glibc's is rounded */
+    void *small = std::malloc(13);
+    TEST_CHECK(small != nullptr);
+    const size_t usable = malloc_usable_size(small);
+    TEST_CHECK(usable == 13);
+    std::memset(small, 'a', 13);
+
+    small = std::realloc(small, 100000);
+    TEST_CHECK(small != nullptr);
+    TEST_CHECK(static_cast<char*>(small)[12] == 'a');
+    std::free(small);
+
+    int *zeros = static_cast<int*>(std::calloc(1000, sizeof (int)));
+    TEST_CHECK(zeros != nullptr && zeros[999] == 0);
+    std::free(zeros);
+
+    /* the Tag of a page aligned pointer is on the previous page */
+    void *aligned = nullptr;
+    const int result = posix_memalign(&aligned, 4096, 10);
+    TEST_CHECK(result == 0);
+    TEST_CHECK(reinterpret_cast<uintptr_t>(aligned) % 4096 == 0);
+    std::free(aligned);
+    void *page = valloc(5000);
+    TEST_CHECK(reinterpret_cast<uintptr_t>(page) % sysconf(_SC_PAGESIZE)
+            == 0);
+    std::free(page);
+
+    char *copy = strdup("preload");
+    TEST_CHECK(copy != nullptr && std::strcmp(copy, "preload") == 0);
+    std::free(copy);
+
+    /* a foreign pointer goes back to glibc */
+    void *foreign = __libc_malloc(64);
+    TEST_CHECK(malloc_usable_size(foreign) >= 64);
+    foreign = std::realloc(foreign, 128);
+    TEST_CHECK(malloc_usable_size(foreign) >= 128);
+    std::free(foreign);
+    return 0;
+}
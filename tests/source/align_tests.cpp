@@ -0,0 +1,69 @@
+#include <cstdint>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_memlib_new.h>
+#include <nq_memlib/nq_unique.h>
+#include <nq_memlib/nq_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    struct alignas(64) CacheLine
+    {
+        char data[3];
+    };
+
+    struct AlignTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        enum { alignment = 128 };
+    };
+
+    template<class T>
+    bool is_aligned(const T *ptr, std::size_t align)
+    {
+        return reinterpret_cast<std::uintptr_t>(ptr) % align == 0;
+    }
+}
+
+NQ_DOMAIN_EX(AlignTestDomain, DomainEarth, AlignTestPolicy);
+
+void align_tests()
+{
+    /* C++11 new (used when the memlib is off) ignores over-alignment */
+# ifndef WITH_NQ_MEMOFF
+    {
+        nq::vector<CacheLine, DomainEarth> vec(3);
+        TEST_CHECK(is_aligned(vec.data(), 64));
+
+        CacheLine *ptr = nq::memlib::New<CacheLine, DomainEarth>();
+        TEST_CHECK(is_aligned(ptr, 64));
+        nq::memlib::Delete<CacheLine, DomainEarth>(ptr);
+
+        CacheLine *array = nq::memlib::New_array<CacheLine, DomainEarth>(5);
+        TEST_CHECK(is_aligned(array, 64));
+        nq::memlib::Delete_array<CacheLine, DomainEarth>(array);
+
+        CacheLine *nq_array = NQ_NEW_ARRAY(DomainEarth, CacheLine, 5);
+        TEST_CHECK(is_aligned(nq_array, 64));
+        NQ_DELETE_ARAY(nq_array);
+
+        auto unique = nq::make_unique<CacheLine[], DomainEarth>(4);
+        TEST_CHECK(is_aligned(unique.get(), 64));
+
+        /* a 4 bytes element used to follow a 4 bytes ArrayHeader */
+        double *doubles = nq::memlib::New_array<double, DomainEarth>(3);
+        TEST_CHECK(is_aligned(doubles, alignof(double)));
+        nq::memlib::Delete_array<double, DomainEarth>(doubles);
+    }
+    {
+        nq::vector<char, AlignTestDomain> vec(10);
+        TEST_CHECK(is_aligned(vec.data(), 128));
+    }
+# endif // !WITH_NQ_MEMOFF
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(DomainEarth::getInstance().get_count() == 0);
+    TEST_CHECK(AlignTestDomain::getInstance().get_count() == 0);
+# endif // !WITH_NQ_MEMLOG
+}
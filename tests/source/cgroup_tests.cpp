@@ -0,0 +1,144 @@
+#include <atomic>
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include <nq_memlib/nq_cgroup.h>
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/pool_alloc.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    /* fake cgroup files in the working directory */
+    void write_cgroup(const char* max, const char* high, const char* current)
+    {
+        std::ofstream("memory.max") << max << "\n";
+        std::ofstream("memory.high") << high << "\n";
+        std::ofstream("memory.current") << current << "\n";
+    }
+
+# ifdef WITH_NQ_MEMLOG
+    /* test 1000000 bytes of DomainEarth against the budgets */
+    bool alloc_earth()
+    {
+        try
+        {
+            nq::vector<char, DomainEarth> vec(1000000);
+        }
+        catch (const nq::memlib::domain_bad_alloc&)
+        {
+            return false;
+        }
+        return true;
+    }
+# endif // !WITH_NQ_MEMLOG
+
+    /* a ChunkSource of its own, so the reserved chunks are only the test's */
+    struct CgroupSource : nq::memlib::PageSource
+    {};
+
+    /* called from the pressure thread */
+    std::atomic<int> pressure_calls(0);
+    std::atomic<double> pressure_usage(0);
+
+    void on_pressure(const nq::memlib::MemoryPressure& pressure)
+    {
+        ++pressure_calls;
+        pressure_usage = pressure.usage;
+    }
+}
+
+void cgroup_tests()
+{
+    nq::memlib::set_cgroup_path(".");
+    write_cgroup("max", "max", "1000");
+
+    nq::memlib::CgroupMemory memory;
+    bool read = nq::memlib::read_cgroup_memory(memory);
+    TEST_CHECK(read);
+    TEST_CHECK(memory.limit() == nq::memlib::no_cgroup_limit);
+    TEST_CHECK(memory.current == 1000);
+    nq::memlib::set_domain_budget("DomainEarth", 0.5);
+    TEST_CHECK(nq::memlib::get_domain_budget("DomainEarth") == 0);
+
+    /* memory.high is the limit when it is the lowest */
+    write_cgroup("2000000", "1000000", "500000");
+    read = nq::memlib::read_cgroup_memory(memory);
+    TEST_CHECK(read);
+    TEST_CHECK(memory.max == 2000000 && memory.limit() == 1000000);
+    TEST_CHECK(nq::memlib::get_domain_budget("DomainEarth") == 500000);
+    TEST_CHECK(nq::memlib::get_domain_budget("DomainSpace") == 0);
+    TEST_CHECK(!nq::memlib::over_budget("DomainEarth"));
+# ifdef WITH_NQ_MEMLOG
+    {
+        nq::vector<char, DomainEarth> vec(600000);
+        TEST_CHECK(nq::memlib::over_budget("DomainEarth"));
+    }
+# endif // !WITH_NQ_MEMLOG
+
+    /* the budgets are the quotas of the Domains, they follow the limit */
+    nq::memlib::set_domain_budget("DomainEarth", 0.5, 0.8);
+    BaseDomain& earth = DomainEarth::getInstance();
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(earth.get_soft_quota() == 500000);
+    TEST_CHECK(earth.get_hard_quota() == 800000);
+    TEST_CHECK(!alloc_earth());
+    write_cgroup("4000000", "max", "500000");
+    nq::memlib::check_memory_pressure();
+    TEST_CHECK(earth.get_hard_quota() == 3200000);
+    TEST_CHECK(alloc_earth());
+    write_cgroup("2000000", "1000000", "500000");
+    nq::memlib::check_memory_pressure();
+# endif // !WITH_NQ_MEMLOG
+    nq::memlib::set_domain_budget("DomainEarth", 0.5);
+    TEST_CHECK(earth.get_hard_quota() == BaseDomain::no_quota);
+    nq::memlib::set_pool_cache_share(0.25);
+    TEST_CHECK(nq::memlib::get_pool_cache_limit() == 250000);
+
+    /* above the cache limit without pressure the reserved chunks stay */
+    nq::memlib::SlabPool& pool = PoolAlloc<CgroupSource>::pool();
+    const size_t reserved = pool.reserve(1);
+    TEST_CHECK(reserved == nq::memlib::PageSource::chunk_size);
+    nq::memlib::add_pressure_callback(on_pressure);
+    bool pressure = nq::memlib::check_memory_pressure();
+    TEST_CHECK(!pressure);
+    TEST_CHECK(pressure_calls == 0);
+    TEST_CHECK(pool.get_reserved_size() == reserved);
+
+    write_cgroup("2000000", "1000000", "950000");
+    pressure = nq::memlib::check_memory_pressure();
+    TEST_CHECK(pressure);
+    TEST_CHECK(pressure_calls == 1 && pressure_usage.load() == 0.95);
+    TEST_CHECK(pool.get_reserved_size() == 0);
+    nq::memlib::set_pressure_threshold(0.99);
+    pressure = nq::memlib::check_memory_pressure();
+    TEST_CHECK(!pressure);
+
+    nq::memlib::set_pressure_threshold(0.9);
+    const bool started =
+        nq::memlib::start_pressure_thread(std::chrono::milliseconds(1));
+    TEST_CHECK(started);
+    for (int i = 0; i < 1000 && pressure_calls < 3; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    nq::memlib::stop_pressure_thread();
+    TEST_CHECK(pressure_calls >= 3);
+
+    nq::memlib::remove_pressure_callback(on_pressure);
+    int calls = pressure_calls;
+    pressure = nq::memlib::check_memory_pressure();
+    TEST_CHECK(pressure);
+    TEST_CHECK(pressure_calls == calls);
+
+    nq::memlib::set_pool_cache_share(0);
+    nq::memlib::set_domain_budget("DomainEarth", 0);
+    TEST_CHECK(earth.get_soft_quota() == BaseDomain::no_quota);
+    std::remove("memory.max");
+    std::remove("memory.high");
+    std::remove("memory.current");
+    read = nq::memlib::read_cgroup_memory(memory);
+    TEST_CHECK(!read);
+}
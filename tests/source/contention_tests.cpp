@@ -0,0 +1,57 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/contended_mutex.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+NQ_DOMAIN(ContentionTestDomain, DomainEarth);
+
+void contention_tests()
+{
+    {
+        nq::memlib::ContendedMutex mutex;
+        {
+            std::lock_guard<nq::memlib::ContendedMutex> locker(mutex);
+        }
+        TEST_CHECK(mutex.get_uncontended() == 1 && mutex.get_contended() == 0);
+
+        /* the lock is held by another thread: lock() waits */
+        std::atomic<bool> held(false);
+        std::thread holder([&mutex, &held]()
+        {
+            std::lock_guard<nq::memlib::ContendedMutex> locker(mutex);
+            held = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        });
+        while (!held)
+            std::this_thread::yield();
+        mutex.lock();
+        mutex.unlock();
+        holder.join();
+        TEST_CHECK(mutex.get_contended() == 1);
+        TEST_CHECK(mutex.get_uncontended() == 2);
+        TEST_CHECK(mutex.get_wait_ns() > 0);
+
+        mutex.reset_contention();
+        TEST_CHECK(mutex.get_contended() == 0 && mutex.get_wait_ns() == 0);
+    }
+
+# ifdef WITH_NQ_MEMLOG
+    /* the full level lists the Headers under the Domain mutex */
+    ContentionTestDomain& dom = ContentionTestDomain::getInstance();
+    {
+        nq::vector<int, ContentionTestDomain> vec(10);
+    }
+    TEST_CHECK(dom.get_lock_uncontended() + dom.get_lock_contended() == 2);
+
+    std::vector<DomainSnapshot> snaps;
+    dom.snapshot(snaps);
+    TEST_CHECK(snaps.front().lock_uncontended + snaps.front().lock_contended
+                >= 2);
+# endif // !WITH_NQ_MEMLOG
+}
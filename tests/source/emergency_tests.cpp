@@ -0,0 +1,146 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_cgroup.h>
+#include <nq_memlib/emergency_reserve.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    bool out_of_memory = false;
+    std::atomic<int> nb_pressures(0); // also counted by the pressure thread
+
+    /* AllocStrat failing while out_of_memory is set */
+    struct FailingAlloc
+    {
+        void* allocate(std::size_t size)
+        {
+            return out_of_memory ? nullptr : std::malloc(size);
+        }
+
+        void deallocate(void *ptr)
+        {
+            std::free(ptr);
+        }
+    };
+
+    struct EmergencyTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        typedef FailingAlloc alloc_strat;
+        enum { emergency_reserve = 1 << 16 };
+    };
+
+    void on_pressure(const nq::memlib::MemoryPressure&)
+    {
+        ++nb_pressures;
+    }
+}
+
+NQ_DOMAIN_EX(EmergencyTestDomain, DomainEarth, EmergencyTestPolicy);
+
+void emergency_tests()
+{
+    nq::memlib::EmergencyReserve& reserve =
+        nq::memlib::emergency_reserve<EmergencyTestDomain>();
+    TEST_CHECK(nq::memlib::EmergencyReserve::any_reserve());
+    {
+        /* the reserve itself, first fit with coalescing */
+        const size_t free_size = reserve.get_free_size();
+        TEST_CHECK(free_size >= reserve.get_size());
+        void *first = reserve.allocate(1000, 16);
+        void *second = reserve.allocate(3000, 64);
+        TEST_CHECK(first != nullptr && second != nullptr);
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(second) % 64 == 0);
+        TEST_CHECK(reserve.owns(first) && reserve.owns(second));
+        const bool first_freed = reserve.deallocate(first);
+        const bool second_freed =
+            nq::memlib::EmergencyReserve::deallocate_any(second);
+        TEST_CHECK(first_freed && second_freed);
+        TEST_CHECK(reserve.get_free_size() == free_size);
+        void *too_big = reserve.allocate(free_size + 1, 16);
+        TEST_CHECK(too_big == nullptr);
+        int local = 0;
+        TEST_CHECK(!reserve.owns(&local));
+    }
+
+# ifndef WITH_NQ_MEMOFF
+    typedef nq::vector<char, EmergencyTestDomain> Buffer;
+    nq::memlib::add_pressure_callback(on_pressure);
+    {
+        out_of_memory = true;
+        {
+            /* the strategy fails, the reserve takes over */
+            Buffer saved(4000);
+            TEST_CHECK(reserve.owns(saved.data()));
+            /* the pressure is only requested, checking it serves it */
+            TEST_CHECK(nb_pressures == 0);
+            const bool pressure = nq::memlib::check_memory_pressure();
+            TEST_CHECK(pressure && nb_pressures == 1);
+
+            bool thrown = false;
+            try
+            {
+                Buffer too_big(reserve.get_free_size() + 1);
+            }
+            catch (const std::bad_alloc&)
+            {
+                thrown = true;
+            }
+            TEST_CHECK(thrown);
+
+            /* memory is back: the reserve gets a new region */
+            out_of_memory = false;
+            Buffer normal(100);
+            TEST_CHECK(!reserve.owns(normal.data()));
+            TEST_CHECK(!reserve.needs_refill());
+        }
+        TEST_CHECK(reserve.get_free_size() >= reserve.get_size());
+
+        /* the failed too_big asked too, checking it serves it */
+        const bool served = nq::memlib::check_memory_pressure();
+        TEST_CHECK(served && nb_pressures == 2);
+
+        /* the pressure thread serves a request without waiting its period */
+        const bool started =
+            nq::memlib::start_pressure_thread(std::chrono::hours(1));
+        TEST_CHECK(started);
+        nq::memlib::request_memory_pressure();
+        for (int i = 0; i < 1000 && nb_pressures < 3; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        nq::memlib::stop_pressure_thread();
+        TEST_CHECK(nb_pressures == 3);
+    }
+    nq::memlib::remove_pressure_callback(on_pressure);
+# endif // !WITH_NQ_MEMOFF
+
+    {
+        /* past max_regions the reserve stops asking for a refill */
+        std::vector<void*> blocks;
+        for (size_t i = 0; i <= nq::memlib::EmergencyReserve::max_regions;
+                ++i)
+        {
+            for (size_t size = reserve.get_size(); size >= 16; size /= 16)
+            {
+                while (void *block = reserve.allocate(size, 16))
+                    blocks.push_back(block);
+            }
+            reserve.refill();
+        }
+        TEST_CHECK(reserve.get_free_size() < reserve.get_size());
+        TEST_CHECK(!reserve.needs_refill());
+        const bool refilled = reserve.refill();
+        TEST_CHECK(!refilled);
+        for (void *block : blocks)
+            reserve.deallocate(block);
+        TEST_CHECK(reserve.get_free_size() >= reserve.get_size());
+        /* the requests of the failed allocations above */
+        nq::memlib::check_memory_pressure();
+    }
+}
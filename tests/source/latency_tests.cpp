@@ -0,0 +1,65 @@
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_memlib_tools.h>
+#include <nq_memlib/latency_histogram.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    struct LatencyTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        enum { latency_stats = 1 };
+    };
+}
+
+NQ_DOMAIN_EX(LatencyTestDomain, DomainEarth, LatencyTestPolicy);
+
+void latency_tests()
+{
+    {
+        /* the percentiles are the upper bound of their power of 2 */
+        nq::memlib::LatencyHistogram histogram;
+        TEST_CHECK(histogram.percentile(0.5) == 0);
+        for (int index = 0; index < 1000; ++index)
+            histogram.record(100);
+        for (int index = 0; index < 10; ++index)
+            histogram.record(100000);
+        nq::memlib::LatencySnapshot snap = histogram.snapshot();
+        TEST_CHECK(snap.count == 1010);
+        TEST_CHECK(snap.p50 == 128 && snap.p99 == 128);
+        TEST_CHECK(snap.p999 == 131072);
+        histogram.reset();
+        TEST_CHECK(histogram.count() == 0);
+    }
+
+# ifdef WITH_NQ_MEMLOG
+    LatencyTestDomain& dom = LatencyTestDomain::getInstance();
+    {
+        nq::vector<int, LatencyTestDomain> small(10);
+        nq::vector<char, LatencyTestDomain> big(1 << 16);
+    }
+    /* two allocations and two deallocations */
+    TEST_CHECK(dom.get_strategy_latency().count() == 4);
+    TEST_CHECK(dom.get_domain_latency().count() == 4);
+
+    std::vector<DomainSnapshot> snaps;
+    dom.snapshot(snaps);
+    TEST_CHECK(snaps.front().strategy_latency.count == 4);
+    dom.reset_latency();
+    TEST_CHECK(dom.get_domain_latency().count() == 0);
+
+    /* the unsized deallocations are timed too */
+    void *raw = nq::memlib::allocate_log_aligned<LatencyTestDomain>(64,
+            LatencyTestDomain::header_size, 16);
+    nq::memlib::deallocate_log<LatencyTestDomain>(raw,
+            LatencyTestDomain::header_size, 16);
+    TEST_CHECK(dom.get_strategy_latency().count() == 2);
+    TEST_CHECK(dom.get_domain_latency().count() == 2);
+    dom.reset_latency();
+
+    /* the Domains without latency_stats don't time anything */
+    { nq::vector<int, DomainEarth> untimed(10); }
+    TEST_CHECK(DomainEarth::getInstance().get_strategy_latency().count() == 0);
+# endif // !WITH_NQ_MEMLOG
+}
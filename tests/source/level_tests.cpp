@@ -0,0 +1,48 @@
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_memlib_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+void level_tests()
+{
+# ifdef WITH_NQ_MEMLOG
+    DomainSpace& space = DomainSpace::getInstance();
+    const size_t count = space.get_count();
+
+    /* an allocation made at full level is undone after a level change */
+    int *full = nq::memlib::New<int, DomainSpace>(1);
+    TEST_CHECK(space.get_count() == count + 1);
+    space.set_level(nq::memlib::track_off);
+
+    int *off = nq::memlib::New<int, DomainSpace>(2);
+    TEST_CHECK(space.get_count() == count + 1);
+    nq::memlib::Delete<int, DomainSpace>(full);
+    TEST_CHECK(space.get_count() == count);
+
+    const bool found = nq::memlib::set_tracking_level("DomainSpace",
+            nq::memlib::track_counters);
+    const bool unknown_found = nq::memlib::set_tracking_level("NoSuchDomain",
+            nq::memlib::track_off);
+    TEST_CHECK(found && !unknown_found);
+    {
+        nq::vector<int, DomainSpace> vec(10);
+        TEST_CHECK(space.get_count() == count + 1);
+        TEST_CHECK(space.get_size() >= 10 * sizeof (int));
+    }
+    TEST_CHECK(space.get_count() == count);
+
+    space.set_level(nq::memlib::track_sampled);
+    space.set_sample_rate(4);
+    int *sampled[8];
+    for (int i = 0; i < 8; ++i)
+        sampled[i] = nq::memlib::New<int, DomainSpace>(i);
+    TEST_CHECK(space.get_count() == count + 8);
+    for (int i = 0; i < 8; ++i)
+        nq::memlib::Delete<int, DomainSpace>(sampled[i]);
+
+    nq::memlib::Delete<int, DomainSpace>(off);
+    TEST_CHECK(space.get_count() == count);
+    nq::memlib::set_tracking_level(nq::memlib::track_full);
+# endif // !WITH_NQ_MEMLOG
+}
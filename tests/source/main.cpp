@@ -1,8 +1,46 @@
 void tests();
 void perf_test();
+void report_tests();
+void level_tests();
+void policy_tests();
+void scope_tests();
+void align_tests();
+void side_table_tests();
+void mmap_tests();
+void pool_tests();
+void numa_tests();
+void profile_tests();
+void cgroup_tests();
+void quota_tests();
+void emergency_tests();
+void retag_tests();
+void thread_tests();
+void type_tests();
+void no_alloc_tests();
+void latency_tests();
+void contention_tests();
 
 int main()
 {
     //perf_test();
     tests();
+    report_tests();
+    level_tests();
+    policy_tests();
+    scope_tests();
+    align_tests();
+    side_table_tests();
+    mmap_tests();
+    pool_tests();
+    numa_tests();
+    profile_tests();
+    cgroup_tests();
+    quota_tests();
+    emergency_tests();
+    retag_tests();
+    thread_tests();
+    type_tests();
+    no_alloc_tests();
+    latency_tests();
+    contention_tests();
 }
@@ -0,0 +1,133 @@
+#include <cstdint>
+#include <thread>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_raw_vector.h>
+#include <nq_memlib/mmap_alloc.h>
+#include <nq_memlib/side_table.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+typedef MmapAlloc<(1 << 16)> TestMmapAlloc;
+
+/* TestMmapAlloc counting the mappings it remaps */
+struct RemapCountAlloc : TestMmapAlloc
+{
+    static int remaps;
+
+    void* reallocate(void *ptr, std::size_t old_size, std::size_t new_size,
+            std::size_t align)
+    {
+        void *new_ptr = TestMmapAlloc::reallocate(ptr, old_size, new_size,
+                align);
+        if (new_ptr != nullptr)
+            ++remaps;
+        return new_ptr;
+    }
+};
+
+int RemapCountAlloc::remaps = 0;
+
+namespace
+{
+    struct ThreadStatsPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        enum { thread_stats = 1 };
+    };
+}
+
+NQ_DOMAIN_EX(MmapThreadDomain, DomainEarth, ThreadStatsPolicy);
+
+void mmap_tests()
+{
+# ifndef WITH_NQ_MEMOFF
+    size_t count = DomainEarth::getInstance().get_count();
+    {
+        nq::vector<int, DomainEarth, TestMmapAlloc> small(10, 3);
+        nq::vector<int, DomainEarth, TestMmapAlloc> vec;
+
+        for (int i = 0; i < 1 << 20; ++i)
+            vec.push_back(i);
+        for (int i = 0; i < 1 << 20; ++i)
+            TEST_CHECK(vec[i] == i);
+        /* mapped memory is page aligned */
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(vec.data()) % 4096 == 0);
+
+        vec.resize(3 << 20, 7);
+        TEST_CHECK(vec[(1 << 20) - 1] == (1 << 20) - 1 && vec[2 << 20] == 7);
+        vec.reserve(4 << 20);
+        TEST_CHECK(vec.capacity() == 4 << 20 && vec.size() == 3 << 20);
+        TEST_CHECK(small[9] == 3);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(DomainEarth::getInstance().get_count() == count + 2);
+        TEST_CHECK(DomainEarth::getInstance().get_size()
+                    >= (4 << 20) * sizeof (int));
+# endif // !WITH_NQ_MEMLOG
+    }
+    TEST_CHECK(DomainEarth::getInstance().get_count() == count);
+
+    /* an array remapped by another thread stays counted as it was */
+    {
+        BaseDomain& dom = MmapThreadDomain::getInstance();
+        auto all_frees = [&dom]() {
+            size_t frees = 0;
+            for (size_t alloc = 0; alloc < nq::memlib::tracked_threads;
+                    ++alloc)
+                for (size_t index = 0; index < nq::memlib::tracked_threads;
+                        ++index)
+                    frees += dom.get_thread_frees(alloc, index);
+            return frees;
+        };
+        const size_t headers = MmapThreadDomain::header_size;
+        TestMmapAlloc strat;
+        int *array = nq::memlib::allocate_log<int, MmapThreadDomain>(strat,
+                1 << 16, headers);
+        for (int i = 0; i < 1 << 16; ++i)
+            array[i] = i;
+        const size_t frees = all_frees();
+        int *grown = nullptr;
+        std::thread([&]() {
+            grown = nq::memlib::reallocate_log<int, MmapThreadDomain>(strat,
+                    array, 1 << 16, 1 << 18, headers);
+        }).join();
+        TEST_CHECK(grown != nullptr && grown[(1 << 16) - 1] == (1 << 16) - 1);
+        TEST_CHECK(all_frees() == frees);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(dom.get_count() == 1);
+        TEST_CHECK(dom.get_thread_live(nq::memlib::thread_index())
+                >= (1 << 18) * sizeof (int));
+# endif // !WITH_NQ_MEMLOG
+        nq::memlib::deallocate_log<int, MmapThreadDomain>(strat, grown,
+                1 << 18, headers);
+    }
+    TEST_CHECK(MmapThreadDomain::getInstance().get_count() == 0);
+
+    /* a raw_vector grows its mapped storage by remapping it */
+    {
+        nq::raw_vector<int, DomainEarth, RemapCountAlloc> vec;
+
+        for (int i = 0; i < 1 << 20; ++i)
+            vec.push_back(i);
+        bool in_order = true;
+        for (int i = 0; i < 1 << 20; ++i)
+            in_order = in_order && vec[i] == i;
+        TEST_CHECK(in_order);
+        /* 1 << 14 ints are mapped, the doublings up to 1 << 20 remap */
+        TEST_CHECK(RemapCountAlloc::remaps == 6);
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(vec.data()) % 4096 == 0);
+
+        vec.resize(3 << 20, 7);
+        TEST_CHECK(vec.size() == 3 << 20 && vec[2 << 20] == 7);
+        TEST_CHECK(vec[(1 << 20) - 1] == (1 << 20) - 1);
+        nq::raw_vector<int, DomainEarth, RemapCountAlloc> copy(vec);
+        vec.clear();
+        vec.shrink_to_fit();
+        TEST_CHECK(vec.capacity() == 0 && copy[(1 << 20) - 1] == (1 << 20) - 1);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(DomainEarth::getInstance().get_count() == count + 1);
+# endif // !WITH_NQ_MEMLOG
+    }
+    TEST_CHECK(DomainEarth::getInstance().get_count() == count);
+# endif // !WITH_NQ_MEMOFF
+}
@@ -0,0 +1,48 @@
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/no_alloc_scope.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    size_t nb_reported = 0;
+    size_t reported_size = 0;
+
+    void on_alloc(size_t size)
+    {
+        ++nb_reported;
+        reported_size += size;
+        /* the handler can allocate */
+        nq::vector<char, DomainEarth> log(16);
+    }
+}
+
+void no_alloc_tests()
+{
+    nq::memlib::set_no_alloc_handler(on_alloc);
+    const size_t total = nq::memlib::get_no_alloc_total();
+    nq::vector<int, DomainEarth> ready(100);
+    {
+        nq::no_alloc_scope guard;
+        ready[0] = 1;
+        TEST_CHECK(guard.count() == 0);
+
+        void *ptr = nq::memlib::allocate_aligned<DefaultAlloc>(64, 16);
+        TEST_CHECK(guard.count() == 1 && guard.size() == 64);
+        TEST_CHECK(nb_reported == 1 && reported_size == 64);
+        nq::memlib::deallocate<DefaultAlloc>(ptr);
+# ifndef WITH_NQ_MEMOFF
+        {
+            nq::no_alloc_scope nested;
+            nq::vector<int, DomainEarth> vec(10);
+            TEST_CHECK(nested.count() == 1);
+        }
+        TEST_CHECK(guard.count() == 2);
+# endif // !WITH_NQ_MEMOFF
+    }
+    /* outside of any scope nothing is counted */
+    nq::vector<int, DomainEarth> after(10);
+    TEST_CHECK(nq::memlib::get_no_alloc_total() == total + nb_reported);
+    nq::memlib::set_no_alloc_handler(nullptr);
+}
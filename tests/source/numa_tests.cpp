@@ -0,0 +1,82 @@
+#include <utility>
+#include <vector>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/numa_alloc.h>
+#include <nq_memlib/mmap_alloc.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+void numa_tests()
+{
+    const int count = nq::memlib::numa_node_count();
+    TEST_CHECK(count >= 1);
+    TEST_CHECK(nq::memlib::current_numa_node() >= 0
+                && nq::memlib::current_numa_node() < count);
+
+    /* a single node machine has one unbound arena */
+    const int last = count - 1;
+    nq::memlib::SlabPool& pool = nq::memlib::numa_pool(last);
+    TEST_CHECK(pool.get_node() == (count == 1 ? -1 : last
+                    % nq::memlib::max_numa_nodes));
+    TEST_CHECK(&nq::memlib::numa_pool(NumaAlloc::current_node)
+                == &nq::memlib::numa_pool(nq::memlib::current_numa_node()));
+
+    /* any instance frees the memory of any node */
+    size_t chunks_size = pool.get_chunks_size();
+    void *big = NumaAlloc(last).allocate(1 << 20);
+    TEST_CHECK(big != nullptr);
+    TEST_CHECK(pool.get_chunks_size() > chunks_size);
+    NumaAlloc().deallocate(big);
+    TEST_CHECK(pool.get_chunks_size() == chunks_size);
+
+    /* the chunks bound on a node are usable */
+    {
+        nq::memlib::SlabPool bound(&nq::memlib::PageSource::allocate_chunk,
+                &nq::memlib::PageSource::deallocate_chunk,
+                nq::memlib::PageSource::chunk_size, 0);
+        int *values = static_cast<int*>(bound.allocate(1024 * sizeof (int),
+                    alignof(int)));
+        for (int i = 0; i < 1024; ++i)
+            values[i] = i;
+        TEST_CHECK(values[1023] == 1023);
+        bound.deallocate(values);
+    }
+
+# ifndef WITH_NQ_MEMOFF
+    {
+        typedef nq::allocator<int, DomainEarth, NumaAlloc> Allocator;
+        nq::vector<int, DomainEarth, NumaAlloc> vec{Allocator(NumaAlloc(last))};
+        TEST_CHECK(vec.get_allocator().strategy().node() == last);
+        for (int i = 0; i < 10000; ++i)
+            vec.push_back(i);
+        nq::vector<int, DomainEarth, NumaAlloc> copy(vec);
+        for (int i = 0; i < 10000; ++i)
+            TEST_CHECK(vec[i] == i && copy[i] == i);
+    }
+
+    /* the containers of stateful strategies move-assign and swap */
+    {
+        typedef nq::allocator<int, DomainEarth, NumaAlloc> NumaAllocator;
+        typedef nq::allocator<int, DomainEarth, MmapAlloc<>> MmapAllocator;
+        TEST_CHECK(NumaAllocator(NumaAlloc(0))
+                    == NumaAllocator(NumaAlloc(last)));
+        TEST_CHECK(NumaAllocator() != MmapAllocator());
+
+        std::vector<int, NumaAllocator> numa(100, 1);
+        std::vector<int, NumaAllocator> other_numa(10, 2);
+        numa = std::move(other_numa);
+        TEST_CHECK(numa.size() == 10 && numa[9] == 2);
+        std::swap(numa, other_numa);
+        TEST_CHECK(other_numa.size() == 10 && numa.empty());
+
+        std::vector<int, MmapAllocator> mapped(1 << 20, 3);
+        std::vector<int, MmapAllocator> other_mapped(10, 4);
+        mapped = std::move(other_mapped);
+        TEST_CHECK(mapped.size() == 10 && mapped[9] == 4);
+        mapped.swap(other_mapped);
+        TEST_CHECK(other_mapped.size() == 10 && mapped.empty());
+    }
+# endif // !WITH_NQ_MEMOFF
+}
@@ -0,0 +1,84 @@
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_map.h>
+#include <nq_memlib/nq_memlib_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    size_t nb_counted = 0;
+
+    /* DefaultAlloc counting its live allocations */
+    struct CountingAlloc
+    {
+        void* allocate(std::size_t size)
+        {
+            ++nb_counted;
+            return std::malloc(size);
+        }
+
+        void deallocate(void *ptr)
+        {
+            --nb_counted;
+            std::free(ptr);
+        }
+    };
+
+    size_t nb_sized_bytes = 0;
+
+    /* AllocStrat checking the size given back to deallocate */
+    struct SizedAlloc
+    {
+        void* allocate(std::size_t size)
+        {
+            nb_sized_bytes += size;
+            return std::malloc(size);
+        }
+
+        void deallocate(void *ptr, std::size_t size)
+        {
+            TEST_CHECK(size <= nb_sized_bytes);
+            nb_sized_bytes -= size;
+            std::free(ptr);
+        }
+    };
+
+    struct PolicyTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        typedef CountingAlloc alloc_strat;
+        enum { level = nq::memlib::track_counters };
+    };
+}
+
+NQ_DOMAIN_EX(PolicyTestDomain, DomainEarth, PolicyTestPolicy);
+
+void policy_tests()
+{
+    {
+        nq::vector<int, PolicyTestDomain> vec(10);
+        nq::map<int, int, PolicyTestDomain> map{{1, 2}, {3, 4}};
+        int *ptr = nq::memlib::New<int, PolicyTestDomain>(3);
+# ifndef WITH_NQ_MEMOFF
+        TEST_CHECK(nb_counted == 4);
+# endif // !WITH_NQ_MEMOFF
+        nq::memlib::Delete<int, PolicyTestDomain>(ptr);
+    }
+    TEST_CHECK(nb_counted == 0);
+
+    {
+        nq::vector<long, PolicyTestDomain, SizedAlloc> vec(10);
+        vec.resize(100);
+        long *ptr = nq::memlib::New<long, PolicyTestDomain, SizedAlloc>(3);
+        long *array = nq::memlib::New_array<long, PolicyTestDomain,
+            SizedAlloc>(7);
+        nq::memlib::Delete<long, PolicyTestDomain, SizedAlloc>(ptr);
+        nq::memlib::Delete_array<long, PolicyTestDomain, SizedAlloc>(array);
+    }
+    TEST_CHECK(nb_sized_bytes == 0);
+
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(PolicyTestDomain::getInstance().get_level()
+                == nq::memlib::track_counters);
+# endif // !WITH_NQ_MEMLOG
+}
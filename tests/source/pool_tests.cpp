@@ -0,0 +1,180 @@
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_map.h>
+#include <nq_memlib/nq_memlib_new.h>
+#include <nq_memlib/pool_alloc.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    struct alignas(64) CacheLine
+    {
+        char data[24];
+    };
+
+    /* a ChunkSource of its own, so PoolAlloc<PrefaultSource> has its pool */
+    struct PrefaultSource : nq::memlib::PageSource
+    {};
+
+    struct TrimSource : nq::memlib::PageSource
+    {};
+}
+
+void pool_tests()
+{
+    typedef nq::memlib::SlabPool SlabPool;
+
+    /* every class holds its sizes and the next one is bigger */
+    for (size_t size = 1; size <= SlabPool::max_class_size; ++size)
+    {
+        size_t index = SlabPool::class_of(size, 16);
+        TEST_CHECK(index < SlabPool::nb_classes);
+        TEST_CHECK(SlabPool::class_size(index) >= size);
+        TEST_CHECK(index == 0 || SlabPool::class_size(index - 1) < size);
+    }
+    TEST_CHECK(SlabPool::class_of(SlabPool::max_class_size + 1, 16)
+                == SlabPool::nb_classes);
+    TEST_CHECK(SlabPool::class_alignment(SlabPool::class_of(24, 64)) >= 64);
+
+# ifndef WITH_NQ_MEMOFF
+    {
+        nq::vector<int, DomainEarth, PoolAlloc<>> vec;
+        nq::map<int, int, DomainEarth, PoolAlloc<>> map;
+        for (int i = 0; i < 10000; ++i)
+        {
+            vec.push_back(i);
+            map[i] = i;
+        }
+        for (int i = 0; i < 10000; ++i)
+            TEST_CHECK(vec[i] == i && map[i] == i);
+
+        CacheLine *array = nq::memlib::New_array<CacheLine, DomainEarth,
+            PoolAlloc<>>(3);
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(array) % 64 == 0);
+        nq::memlib::Delete_array<CacheLine, DomainEarth, PoolAlloc<>>(array);
+    }
+    {
+        size_t huge_size = DomainEarth::getInstance().get_huge_size();
+        nq::vector<char, DomainEarth, HugePageAlloc> vec(3 << 20);
+        vec[(3 << 20) - 1] = 1;
+# ifdef WITH_NQ_MEMLOG
+        if (HugePageAlloc().huge_backed(vec.data()))
+            TEST_CHECK(DomainEarth::getInstance().get_huge_size()
+                        == huge_size + (3 << 20));
+        else
+            TEST_CHECK(DomainEarth::getInstance().get_huge_size() == huge_size);
+# endif // !WITH_NQ_MEMLOG
+        /* transparent huge pages are only advised, not counted as huge */
+        SlabPool& huge_pool = HugePageAlloc::pool();
+        TEST_CHECK(huge_pool.get_huge_chunks_size()
+                + huge_pool.get_advised_chunks_size()
+                <= huge_pool.get_chunks_size());
+        TEST_CHECK(huge_pool.get_huge_chunks_size() == 0
+                || huge_pool.get_advised_chunks_size() == 0);
+        (void)huge_size;
+    }
+    TEST_CHECK(DomainEarth::getInstance().get_huge_size() == 0);
+    TEST_CHECK(HugePageAlloc::pool().get_chunks_size() == 0);
+    TEST_CHECK(HugePageAlloc::pool().get_advised_chunks_size() == 0);
+    {
+        typedef PoolAlloc<PrefaultSource> Alloc;
+        SlabPool& pool = Alloc::pool();
+        pool.set_options(SlabPool::prefault);
+
+        size_t reserved = nq::memlib::reserve_log<DomainSpace, Alloc>(3 << 20);
+        TEST_CHECK(reserved == 4 << 20);
+        TEST_CHECK(pool.get_reserved_size() == reserved);
+        TEST_CHECK(pool.get_faulted_size() == reserved);
+        size_t chunks_size = pool.get_chunks_size();
+        {
+            /* the slabs are carved in the reserved chunks */
+            nq::vector<int, DomainSpace, Alloc> vec(100);
+            TEST_CHECK(pool.get_chunks_size() == chunks_size);
+            TEST_CHECK(pool.get_reserved_size() < reserved);
+            TEST_CHECK(Alloc().prefaulted(vec.data()));
+# ifdef WITH_NQ_MEMLOG
+            TEST_CHECK(DomainSpace::getInstance().get_faulted_size()
+                        == 100 * sizeof (int));
+            TEST_CHECK(DomainSpace::getInstance().get_reserved_size()
+                        == reserved);
+# endif // !WITH_NQ_MEMLOG
+        }
+        TEST_CHECK(DomainSpace::getInstance().get_faulted_size() == 0);
+
+        /* lock_pages faults the pages in even when mlock is refused */
+        SlabPool locked(&nq::memlib::PageSource::allocate_chunk,
+                &nq::memlib::PageSource::deallocate_chunk,
+                nq::memlib::PageSource::chunk_size);
+        locked.set_options(SlabPool::lock_pages);
+        void *big = locked.allocate(1 << 20, 16);
+        TEST_CHECK(locked.prefaulted(big));
+        TEST_CHECK(locked.get_faulted_size() == locked.get_chunks_size());
+        TEST_CHECK(locked.get_locked_size() == 0
+                    || locked.get_locked_size() == locked.get_chunks_size());
+        locked.deallocate(big);
+        TEST_CHECK(locked.get_faulted_size() == 0);
+        TEST_CHECK(locked.get_locked_size() == 0);
+
+        /* a size whose run of chunks can't be computed */
+        void *too_big = locked.allocate(SIZE_MAX - 64, 16);
+        TEST_CHECK(too_big == nullptr);
+        TEST_CHECK(locked.get_chunks_size() == 0);
+    }
+
+    /* the chunks without live block go back to the OS */
+    {
+        typedef PoolAlloc<TrimSource> Alloc;
+        SlabPool& pool = Alloc::pool();
+        Alloc alloc;
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < (5 << 20) / 64; ++i)
+            blocks.push_back(alloc.allocate(64));
+        TEST_CHECK(pool.get_chunks_size() == 3 << 21);
+        size_t trimmed = nq::memlib::trim(alloc);
+        TEST_CHECK(trimmed == 0);
+        trimmed = nq::memlib::trim<DomainEarth>();
+        TEST_CHECK(trimmed == 0);
+
+        /* the last block keeps the last chunk */
+        for (size_t i = 0; i + 1 < blocks.size(); ++i)
+            alloc.deallocate(blocks[i]);
+        trimmed = pool.trim(0, true);
+        TEST_CHECK(trimmed == 0);
+        trimmed = pool.trim(0, true);
+        TEST_CHECK(trimmed == 2 << 21);
+        TEST_CHECK(pool.get_chunks_size() == 1 << 21);
+        /* the freed blocks of the chunk kept are still reused */
+        void *reused = alloc.allocate(64);
+        TEST_CHECK(pool.get_chunks_size() == 1 << 21);
+        alloc.deallocate(reused);
+
+        alloc.deallocate(blocks.back());
+        const size_t reserved = pool.reserve(1);
+        TEST_CHECK(reserved == 1 << 21);
+        trimmed = nq::memlib::trim(alloc);
+        TEST_CHECK(trimmed == 2 << 21);
+        TEST_CHECK(pool.get_chunks_size() == 0
+                && pool.get_reserved_size() == 0);
+        TEST_CHECK(pool.get_trimmed_size() == 4 << 21);
+
+        void *block = alloc.allocate(64);
+        alloc.deallocate(block);
+        const bool started =
+            nq::memlib::start_decay_thread(std::chrono::milliseconds(1));
+        const bool restarted =
+            nq::memlib::start_decay_thread(std::chrono::milliseconds(1));
+        TEST_CHECK(started && !restarted);
+        for (int i = 0; i < 1000 && pool.get_chunks_size() != 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        nq::memlib::stop_decay_thread();
+        TEST_CHECK(pool.get_chunks_size() == 0);
+        TEST_CHECK(nq::memlib::get_decayed_size() >= 1 << 21);
+    }
+# endif // !WITH_NQ_MEMOFF
+}
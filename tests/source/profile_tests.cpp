@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <vector>
+
+#include <nq_memlib/nq_memlib_new.h>
+#include <nq_memlib/nq_profile.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    /* a ChunkSource of its own, so the reserved chunks are only the test's */
+    struct ProfileSource : nq::memlib::PageSource
+    {};
+
+    struct ProfileTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        typedef PoolAlloc<ProfileSource> alloc_strat;
+        enum { profile_stats = 1 };
+    };
+
+    /* a 2nd size class, with a slab of its own */
+    struct ProfileBlock
+    {
+        char bytes[200];
+    };
+}
+
+NQ_DOMAIN_EX(ProfileTestDomain, DomainEarth, ProfileTestPolicy);
+NQ_DOMAIN(NoProfileDomain, DomainEarth);
+
+void profile_tests()
+{
+    typedef PoolAlloc<ProfileSource> Alloc;
+
+    std::vector<int*> ints;
+    for (int i = 0; i < 100; ++i)
+        ints.push_back(nq::memlib::New<int, ProfileTestDomain>(i));
+    for (int *ptr : ints)
+        nq::memlib::Delete<int, ProfileTestDomain>(ptr);
+    ints.clear();
+    ints.push_back(nq::memlib::New<int, ProfileTestDomain>(0));
+    nq::memlib::Delete<int, ProfileTestDomain>(ints.back());
+    std::vector<ProfileBlock*> blocks;
+    for (int i = 0; i < 10; ++i)
+        blocks.push_back(nq::memlib::New<ProfileBlock, ProfileTestDomain>());
+    for (ProfileBlock *ptr : blocks)
+        nq::memlib::Delete<ProfileBlock, ProfileTestDomain>(ptr);
+    /* without profile_stats the Domain keeps no peak */
+    nq::memlib::Delete<int, NoProfileDomain>(
+            nq::memlib::New<int, NoProfileDomain>(0));
+
+    const bool saved = nq::memlib::save_profile("profile_tests.txt");
+    nq::memlib::Profile profile;
+    const bool loaded = nq::memlib::load_profile("profile_tests.txt", profile);
+    TEST_CHECK(saved && loaded);
+    std::remove("profile_tests.txt");
+    TEST_CHECK(profile.size() == nq::memlib::current_profile().size());
+
+    size_t reserved = nq::memlib::warmup<ProfileTestDomain>(profile);
+    TEST_CHECK(Alloc::pool().get_reserved_size() == reserved);
+# ifdef WITH_NQ_MEMLOG
+    /* the peak is kept after the frees */
+    size_t found = 0;
+    for (const nq::memlib::ProfileEntry& entry : profile)
+    {
+        if (entry.domain != "ProfileTestDomain")
+            continue;
+        TEST_CHECK((entry.class_size == 16 && entry.peak == 100)
+                || (entry.class_size == 224 && entry.peak == 10));
+        ++found;
+    }
+    TEST_CHECK(found == 2);
+    TEST_CHECK(NoProfileDomain::getInstance().get_class_peak(0) == 0);
+    /* a whole slab for each size class, however few blocks it holds */
+    TEST_CHECK(nq::memlib::profile_size(profile, "ProfileTestDomain",
+                    ProfileTestDomain::header_size)
+            == 2 * nq::memlib::PageSource::chunk_size);
+    TEST_CHECK(reserved == 2 * nq::memlib::PageSource::chunk_size);
+    TEST_CHECK(ProfileTestDomain::getInstance().get_reserved_size()
+            == reserved);
+# else // WITH_NQ_MEMLOG
+    TEST_CHECK(profile.empty() && reserved == 0);
+# endif // !WITH_NQ_MEMLOG
+    Alloc::pool().trim();
+    TEST_CHECK(Alloc::pool().get_reserved_size() == 0);
+}
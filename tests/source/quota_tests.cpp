@@ -0,0 +1,109 @@
+#include <cstring>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+NQ_DOMAIN(QuotaTestDomain, DomainEarth);
+
+# ifdef WITH_NQ_MEMLOG
+namespace
+{
+    int soft_calls = 0;
+    int handler_calls = 0;
+
+    void on_soft_quota(BaseDomain&, size_t)
+    {
+        ++soft_calls;
+    }
+
+    bool let_through(BaseDomain&, size_t)
+    {
+        ++handler_calls;
+        return true;
+    }
+
+    struct Big
+    {
+        char data[1500];
+    };
+
+    struct Throwing
+    {
+        Throwing() { throw 1; }
+    };
+}
+# endif // !WITH_NQ_MEMLOG
+
+void quota_tests()
+{
+# ifdef WITH_NQ_MEMLOG
+    typedef nq::vector<char, QuotaTestDomain> Buffer;
+    QuotaTestDomain& dom = QuotaTestDomain::getInstance();
+    dom.set_quota(1000, 2000);
+    const bool added = dom.add_quota_callback(on_soft_quota);
+    TEST_CHECK(added);
+    {
+        Buffer first(800);
+        TEST_CHECK(soft_calls == 0);
+        {
+            /* crossing the soft quota calls the callbacks once */
+            Buffer second(300);
+            Buffer third(100);
+            TEST_CHECK(soft_calls == 1);
+
+            bool thrown = false;
+            try
+            {
+                Buffer too_big(1000);
+            }
+            catch (const nq::memlib::domain_bad_alloc& e)
+            {
+                thrown = std::strcmp(e.domain(), "QuotaTestDomain") == 0;
+            }
+            TEST_CHECK(thrown);
+            TEST_CHECK(dom.get_size() == 1200);
+
+            /* NQ_NEW throws at the hard quota too */
+            thrown = false;
+            try
+            {
+                NQ_DELETE(NQ_NEW(QuotaTestDomain) Big);
+            }
+            catch (const nq::memlib::domain_bad_alloc& e)
+            {
+                thrown = std::strcmp(e.domain(), "QuotaTestDomain") == 0;
+            }
+            TEST_CHECK(thrown);
+            TEST_CHECK(dom.get_size() == 1200);
+
+            dom.set_quota_handler(let_through);
+            Buffer let(1000);
+            TEST_CHECK(handler_calls == 1);
+            dom.set_quota_handler(nullptr);
+        }
+        /* back under the soft quota, crossing it calls them again */
+        Buffer again(300);
+        TEST_CHECK(soft_calls == 2);
+    }
+    /* the memory of an NQ_NEW whose constructor throws is freed */
+    const size_t count = dom.get_count();
+    bool thrown = false;
+    try
+    {
+        NQ_DELETE(NQ_NEW(QuotaTestDomain) Throwing);
+    }
+    catch (int)
+    {
+        thrown = true;
+    }
+    TEST_CHECK(thrown && dom.get_count() == count);
+
+    dom.remove_quota_callback(on_soft_quota);
+    dom.set_quota(BaseDomain::no_quota);
+    Buffer unlimited(1 << 20);
+    TEST_CHECK(soft_calls == 2);
+# endif // !WITH_NQ_MEMLOG
+}
@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nq_memlib/nq_report.h>
+#include <nq_memlib/nq_unique.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+void report_tests()
+{
+    /* the call sites are only listed at the full level */
+    nq::memlib::set_tracking_level(nq::memlib::track_full);
+
+    auto logged = nq::make_unique<int, DomainSpace>(42);
+    nq::unique_ptr<int, DomainEarth> newed(NQ_NEW(DomainEarth) int(3));
+
+    std::ostringstream os;
+    nq::log::report(os);
+    TEST_CHECK(os.str().find("heap report") != std::string::npos);
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(os.str().find("DomainSpace") != std::string::npos);
+    TEST_CHECK(os.str().find(__FILE__) != std::string::npos);
+
+    /* the call sites are copied by chunks, none is missed */
+    {
+        std::vector<int*> values;
+        for (size_t i = 0; i < 3 * DomainSpace::snapshot_chunk; ++i)
+            values.push_back(NQ_NEW(DomainSpace) int(0));
+        std::vector<DomainSnapshot> snaps;
+        DomainSpace::getInstance().snapshot(snaps);
+        size_t sites = 0;
+        for (const CallSiteSnapshot& site : snaps.front().sites)
+            sites += site.file == std::string(__FILE__);
+        TEST_CHECK(!snaps.front().truncated);
+        TEST_CHECK(sites == values.size());
+        for (int *value : values)
+            NQ_DELETE(value);
+    }
+# endif // !WITH_NQ_MEMLOG
+
+# ifndef NQ_WIN_
+    const char* filepath = "nq_report_test.txt";
+    std::remove(filepath);
+
+    /* the report is written before the quit byte is read by the thread */
+    const bool started = nq::log::start_report_thread(filepath);
+    TEST_CHECK(started);
+    std::raise(SIGUSR1);
+    nq::log::stop_report_thread();
+
+    std::ifstream file(filepath);
+    std::string content((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+    TEST_CHECK(content.find("report requested") != std::string::npos);
+    std::remove(filepath);
+
+    /* the pipe outlives the thread, it can be started again */
+    nq::log::request_report();
+    const bool restarted = nq::log::start_report_thread(filepath);
+    TEST_CHECK(restarted);
+    nq::log::request_report();
+    nq::log::stop_report_thread();
+    std::ifstream again(filepath);
+    TEST_CHECK(again.good());
+    std::remove(filepath);
+# endif // !NQ_WIN_
+}
@@ -0,0 +1,89 @@
+#include <nq_memlib/nq_raw_vector.h>
+#include <nq_memlib/nq_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+NQ_DOMAIN(LoaderDomain, DomainEarth);
+NQ_DOMAIN(RendererDomain, DomainEarth);
+
+void retag_tests()
+{
+    LoaderDomain& loader = LoaderDomain::getInstance();
+    RendererDomain& renderer = RendererDomain::getInstance();
+    {
+        /* the storage changes Domain, inline Header or side table Header */
+        nq::raw_vector<int, LoaderDomain> loaded(100, 7);
+        nq::raw_vector<char, LoaderDomain> big(8192, 'a');
+        const int *loaded_data = loaded.data();
+        const char *big_data = big.data();
+
+        nq::raw_vector<int, RendererDomain> rendered(std::move(loaded));
+        nq::raw_vector<char, RendererDomain> big_rendered;
+        big_rendered = std::move(big);
+        TEST_CHECK(rendered.size() == 100 && rendered[99] == 7);
+        TEST_CHECK(big_rendered.size() == 8192 && big_rendered[0] == 'a');
+        TEST_CHECK(rendered.data() == loaded_data);
+        TEST_CHECK(big_rendered.data() == big_data);
+        TEST_CHECK(loaded.empty() && loaded.data() == nullptr);
+        TEST_CHECK(big.empty() && big.data() == nullptr);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(loader.get_count() == 0 && loader.get_size() == 0);
+        TEST_CHECK(renderer.get_count() == 2);
+        TEST_CHECK(renderer.get_size() == 100 * sizeof (int) + 8192);
+# endif // !WITH_NQ_MEMLOG
+
+        /* it grows and is freed in its new Domain */
+        rendered.resize(1000, 3);
+        TEST_CHECK(rendered[99] == 7 && rendered[999] == 3);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(loader.get_count() == 0);
+        TEST_CHECK(renderer.get_size() == 1000 * sizeof (int) + 8192);
+# endif // !WITH_NQ_MEMLOG
+    }
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(renderer.get_count() == 0 && renderer.get_size() == 0);
+# endif // !WITH_NQ_MEMLOG
+
+    /* an array keeps its memory, inline Header or side table Header */
+    {
+        int *ints = nq::memlib::allocate_log<int, LoaderDomain>(100,
+                LoaderDomain::header_size);
+        char *chars = nq::memlib::allocate_log<char, LoaderDomain>(8192,
+                LoaderDomain::header_size);
+        const bool ints_moved = nq::memlib::retag_log<int, LoaderDomain,
+                RendererDomain>(ints, 100, LoaderDomain::header_size);
+        const bool chars_moved = nq::memlib::retag_log<char, LoaderDomain,
+                RendererDomain>(chars, 8192, LoaderDomain::header_size);
+        TEST_CHECK(ints_moved && chars_moved);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(loader.get_count() == 0 && loader.get_size() == 0);
+        TEST_CHECK(renderer.get_size() == 100 * sizeof (int) + 8192);
+# endif // !WITH_NQ_MEMLOG
+        nq::memlib::deallocate_log<int, RendererDomain>(ints, 100,
+                RendererDomain::header_size);
+        nq::memlib::deallocate_log<char, RendererDomain>(chars, 8192,
+                RendererDomain::header_size);
+    }
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(renderer.get_count() == 0 && renderer.get_size() == 0);
+# endif // !WITH_NQ_MEMLOG
+
+    /* what NQ_NEW allocated is freed from its new Domain */
+    int *value = NQ_NEW(LoaderDomain) int(3);
+    int *array = NQ_NEW_ARRAY(LoaderDomain, int, 10);
+    NQ_RETAG(RendererDomain, value);
+    NQ_RETAG_ARRAY(RendererDomain, array);
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(loader.get_count() == 0);
+    TEST_CHECK(renderer.get_count() == 2);
+    TEST_CHECK(renderer.get_size() == sizeof (int) + 10 * sizeof (int));
+# endif // !WITH_NQ_MEMLOG
+    NQ_DELETE(value);
+    NQ_DELETE_ARAY(array);
+# ifdef WITH_NQ_MEMLOG
+    TEST_CHECK(renderer.get_count() == 0 && renderer.get_size() == 0);
+# endif // !WITH_NQ_MEMLOG
+    (void)loader;
+    (void)renderer;
+}
@@ -0,0 +1,36 @@
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_unique.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+void scope_tests()
+{
+# ifdef WITH_NQ_MEMLOG
+    DomainSpace& space = DomainSpace::getInstance();
+    DomainEarth& earth = DomainEarth::getInstance();
+    const size_t space_count = space.get_count();
+    const size_t earth_count = earth.get_count();
+
+    nq::vector<int, CurrentDomain> *outlive = nullptr;
+    {
+        nq::domain_scope<DomainSpace> space_scope;
+        nq::vector<int, CurrentDomain> vec(3);
+        TEST_CHECK(space.get_count() == space_count + 1);
+        {
+            nq::domain_scope<DomainEarth> earth_scope;
+            outlive = NQ_NEW(CurrentDomain) nq::vector<int, CurrentDomain>(5);
+            TEST_CHECK(earth.get_count() == earth_count + 2);
+        }
+        int *newed = NQ_NEW(CurrentDomain) int(3);
+        TEST_CHECK(space.get_count() == space_count + 2);
+        NQ_DELETE(newed);
+    }
+    TEST_CHECK(space.get_count() == space_count);
+
+    /* freed outside of any scope, from the Domain logged in the Header */
+    NQ_DELETE(outlive);
+    TEST_CHECK(earth.get_count() == earth_count);
+    TEST_CHECK(nq::memlib::current_domain() == nullptr);
+# endif // !WITH_NQ_MEMLOG
+}
@@ -0,0 +1,59 @@
+#include <cstdint>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_memlib_new.h>
+#include <nq_memlib/side_table.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    size_t last_size = 0;
+
+    /* DefaultAlloc remembering the size of its last allocation */
+    struct LastSizeAlloc : DefaultAlloc
+    {
+        using DefaultAlloc::allocate;
+
+        void* allocate(std::size_t size, std::size_t align)
+        {
+            last_size = size;
+            return DefaultAlloc::allocate(size, align);
+        }
+    };
+
+    struct alignas(4096) Page
+    {
+        char data[4096];
+    };
+}
+
+void side_table_tests()
+{
+# ifndef WITH_NQ_MEMOFF
+    size_t count = DomainEarth::getInstance().get_count();
+    size_t side_count = nq::memlib::side_table_size();
+    {
+        /* a page allocation stays one aligned page */
+        nq::vector<Page, DomainEarth, LastSizeAlloc> pages(1);
+        TEST_CHECK(last_size == sizeof (Page));
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(pages.data()) % 4096 == 0);
+
+        nq::vector<char, DomainEarth, LastSizeAlloc> small(100);
+        TEST_CHECK(last_size == 100 + DomainEarth::header_size);
+
+        Page *array = nq::memlib::New_array<Page, DomainEarth>(2);
+        TEST_CHECK(reinterpret_cast<std::uintptr_t>(array) % 4096 == 0);
+# ifdef WITH_NQ_MEMLOG
+        TEST_CHECK(nq::memlib::side_table_size() == side_count + 2);
+        TEST_CHECK(DomainEarth::getInstance().get_count() == count + 3);
+        TEST_CHECK(DomainEarth::getInstance().get_size()
+                    >= 3 * sizeof (Page) + 100);
+# endif // !WITH_NQ_MEMLOG
+        nq::memlib::Delete_array<Page, DomainEarth>(array);
+    }
+    TEST_CHECK(nq::memlib::side_table_size() == side_count);
+    TEST_CHECK(DomainEarth::getInstance().get_count() == count);
+# endif // !WITH_NQ_MEMOFF
+}
@@ -0,0 +1,22 @@
+#ifndef TEST_CHECK_H_
+# define TEST_CHECK_H_
+
+# include <cstdio>
+# include <cstdlib>
+
+/*
+** assert kept in the NDEBUG builds (MINSIZEREL...) so the tests check the
+** same things with every build flags.
+** The condition must not have side effects: store the result of the call
+** first, then check it.
+*/
+# define TEST_CHECK(cond) \
+    ((cond) ? (void)0 : test_check_failed(#cond, __FILE__, __LINE__))
+
+inline void test_check_failed(const char* cond, const char* file, int line)
+{
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+    std::abort();
+}
+
+#endif // !TEST_CHECK_H_
@@ -0,0 +1,57 @@
+#include <thread>
+#include <utility>
+
+#include <nq_memlib/nq_vector.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    struct ThreadStatsPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        enum { thread_stats = 1 };
+    };
+}
+
+NQ_DOMAIN_EX(ThreadTestDomain, DomainEarth, ThreadStatsPolicy);
+NQ_DOMAIN(NoThreadStatsDomain, DomainEarth);
+
+void thread_tests()
+{
+# ifdef WITH_NQ_MEMLOG
+    typedef nq::vector<char, ThreadTestDomain> Buffer;
+    ThreadTestDomain& dom = ThreadTestDomain::getInstance();
+    const size_t self = nq::memlib::thread_index();
+    TEST_CHECK(self == nq::memlib::thread_index());
+
+    Buffer local(100);
+    Buffer given(300);
+    TEST_CHECK(dom.get_thread_live(self) == 400);
+
+    /* the other thread frees what this one allocated */
+    size_t other = self;
+    std::thread worker([&other, &given]()
+    {
+        other = nq::memlib::thread_index();
+        Buffer mine(50);
+        Buffer taken(std::move(given));
+    });
+    worker.join();
+    TEST_CHECK(other != self);
+    TEST_CHECK(dom.get_thread_live(self) == 100);
+    TEST_CHECK(dom.get_thread_live(other) == 0);
+    TEST_CHECK(dom.get_thread_frees(self, other) == 1);
+    TEST_CHECK(dom.get_thread_frees(other, other) == 1);
+    TEST_CHECK(dom.get_thread_frees(self, self) == 0);
+
+    std::vector<DomainSnapshot> snaps;
+    dom.snapshot(snaps);
+    TEST_CHECK(snaps.front().thread_live[self] == 100);
+    TEST_CHECK(snaps.front().thread_frees[self][other] == 1);
+
+    /* without thread_stats the Domain doesn't count them */
+    nq::vector<char, NoThreadStatsDomain> untracked(100);
+    TEST_CHECK(NoThreadStatsDomain::getInstance().get_thread_live(self) == 0);
+# endif // !WITH_NQ_MEMLOG
+}
@@ -0,0 +1,73 @@
+#include <cstring>
+
+#include <nq_memlib/nq_vector.h>
+#include <nq_memlib/nq_map.h>
+#include <nq_memlib/nq_memlib_new.h>
+
+#include "test_check.h"
+#include "test_domains.h"
+
+namespace
+{
+    struct Entity
+    {
+        int id;
+        float position[3];
+    };
+
+    struct TypeTestPolicy : nq::memlib::DefaultDomainPolicy
+    {
+        enum { type_stats = 1 };
+    };
+}
+
+namespace nq
+{
+    REGISTER_TYPE_NAME(Entity)
+}
+
+NQ_DOMAIN_EX(TypeTestDomain, DomainEarth, TypeTestPolicy);
+
+void type_tests()
+{
+    TEST_CHECK(std::strcmp(nq::TypeToString<Entity>(), "Entity") == 0);
+    TEST_CHECK(std::strcmp(nq::TypeToString<double>(), "double") == 0);
+# ifdef WITH_NQ_MEMLOG
+    TypeTestDomain& dom = TypeTestDomain::getInstance();
+    {
+        nq::vector<Entity, TypeTestDomain> entities(10);
+        Entity *entity = nq::memlib::New<Entity, TypeTestDomain>();
+        nq::map<int, Entity, TypeTestDomain> components;
+        components[1];
+        components[2];
+        components[3];
+
+        const size_t id = nq::memlib::register_type("Entity");
+        TEST_CHECK(std::strcmp(nq::memlib::type_name(id), "Entity") == 0);
+        TEST_CHECK(dom.get_type_count(id) == 2);
+        TEST_CHECK(dom.get_type_live(id) == 11 * sizeof (Entity));
+
+        /* the map nodes are counted under their own type */
+        size_t nodes = 0;
+        for (size_t index = 1; index < nq::memlib::tracked_types; ++index)
+        {
+            if (index != id && dom.get_type_count(index) == 3)
+                ++nodes;
+        }
+        TEST_CHECK(nodes == 1);
+
+        /* the allocations without type aren't counted */
+        void *raw = nq::memlib::allocate_log_aligned<TypeTestDomain>(64,
+                TypeTestDomain::header_size, 16);
+        TEST_CHECK(dom.get_type_count(0) == 0);
+        TEST_CHECK(dom.get_type_live(0) == 0);
+        nq::memlib::deallocate_log<TypeTestDomain>(raw,
+                TypeTestDomain::header_size, 16);
+
+        nq::memlib::Delete<Entity, TypeTestDomain>(entity);
+        TEST_CHECK(dom.get_type_count(id) == 1);
+    }
+    for (size_t index = 0; index < nq::memlib::tracked_types; ++index)
+        TEST_CHECK(dom.get_type_count(index) == 0);
+# endif // !WITH_NQ_MEMLOG
+}